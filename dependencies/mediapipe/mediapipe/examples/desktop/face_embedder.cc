@@ -0,0 +1,185 @@
+// Copyright 2019 The MediaPipe Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Runs an exported copy of dlib's face recognition ResNet through TFLite on
+// the XNNPACK delegate, in fp16 or int8.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "mediapipe/framework/port/ret_check.h"
+#include "mediapipe/framework/port/status.h"
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/model.h"
+#include "mediapipe/examples/desktop/face_embedder.h"
+
+namespace {
+
+// dlib::input_rgb_image_sized normalizes every channel as
+// (pixel - mean) / 256 before the first convolution.
+constexpr float kChannelMean[3] = {122.782f, 117.001f, 104.298f}; // R, G, B
+constexpr float kChannelScale = 1.f / 256.f;
+constexpr int kChipSize = 150;
+
+template <typename T>
+void quantizeChip(const cv::Mat& face_chip, const TfLiteQuantizationParams& params, T* input) {
+  const float inverse_scale = 1.f / params.scale;
+  for (int y = 0; y < kChipSize; ++y) {
+    const uint8_t* row = face_chip.ptr<uint8_t>(y);
+    for (int i = 0; i < kChipSize * 3; ++i) {
+      const float value = (row[i] - kChannelMean[i % 3]) * kChannelScale;
+      const float quantized = std::round(value * inverse_scale) + params.zero_point;
+      *input++ = static_cast<T>(std::min<float>(std::max<float>(quantized, std::numeric_limits<T>::min()),
+                                                std::numeric_limits<T>::max()));
+    }
+  }
+}
+
+template <typename T>
+void dequantizeDescriptor(const T* output, const TfLiteQuantizationParams& params, float* descriptor) {
+  for (int i = 0; i < face_descriptor_size; ++i)
+    descriptor[i] = (static_cast<int32_t>(output[i]) - params.zero_point) * params.scale;
+}
+
+}  // namespace
+
+class FaceEmbedder {
+  private:
+  // Declared first so that it outlives the interpreter using it.
+  std::unique_ptr<TfLiteDelegate, decltype(&TfLiteXNNPackDelegateDelete)> delegate{
+    nullptr, &TfLiteXNNPackDelegateDelete};
+  std::unique_ptr<tflite::FlatBufferModel> model;
+  std::unique_ptr<tflite::Interpreter> interpreter;
+
+  public:
+  absl::Status initFaceEmbedder(const std::string& model_file, const FaceEmbedderOptions& options) {
+    this->model = tflite::FlatBufferModel::BuildFromFile(model_file.c_str());
+    RET_CHECK(this->model) << "Unable to load " << model_file;
+
+    // XNNPACK refuses FORCE_FP16 on a CPU without native fp16 arithmetic, so
+    // fall back to fp32 there instead of failing.
+    bool fp16 = options.force_fp16;
+    absl::Status status = this->buildInterpreter(options.num_threads, fp16);
+    if (!status.ok() && fp16) {
+      std::cerr << "fp16 inference is not supported here, falling back to fp32." << std::endl;
+      fp16 = false;
+      status = this->buildInterpreter(options.num_threads, fp16);
+    }
+    MP_RETURN_IF_ERROR(status);
+
+    const TfLiteTensor* input = this->interpreter->input_tensor(0);
+    const bool quantized = input->type == kTfLiteInt8 || input->type == kTfLiteUInt8;
+    std::cerr << "Face embedder running in " << (quantized ? "int8" : fp16 ? "fp16" : "fp32")
+              << " on " << options.num_threads << " XNNPACK threads." << std::endl;
+    RET_CHECK(input->dims->size == 4 && input->dims->data[1] == kChipSize &&
+              input->dims->data[2] == kChipSize && input->dims->data[3] == 3)
+      << "Expected a 1x150x150x3 input";
+    const TfLiteTensor* output = this->interpreter->output_tensor(0);
+    RET_CHECK_EQ(output->bytes / TfLiteTypeGetSize(output->type), face_descriptor_size);
+    return absl::OkStatus();
+  }
+
+  absl::Status computeDescriptor(const cv::Mat& face_chip, float* descriptor) {
+    RET_CHECK(face_chip.type() == CV_8UC3 && face_chip.cols == kChipSize && face_chip.rows == kChipSize);
+
+    TfLiteTensor* input = this->interpreter->input_tensor(0);
+    switch (input->type) {
+      case kTfLiteFloat32: {
+        float* data = input->data.f;
+        for (int y = 0; y < kChipSize; ++y) {
+          const uint8_t* row = face_chip.ptr<uint8_t>(y);
+          for (int i = 0; i < kChipSize * 3; ++i)
+            *data++ = (row[i] - kChannelMean[i % 3]) * kChannelScale;
+        }
+        break;
+      }
+      case kTfLiteInt8:
+        quantizeChip(face_chip, input->params, input->data.int8);
+        break;
+      case kTfLiteUInt8:
+        quantizeChip(face_chip, input->params, input->data.uint8);
+        break;
+      default:
+        return absl::InvalidArgumentError("Unsupported input type.");
+    }
+
+    RET_CHECK_EQ(this->interpreter->Invoke(), kTfLiteOk);
+
+    const TfLiteTensor* output = this->interpreter->output_tensor(0);
+    switch (output->type) {
+      case kTfLiteFloat32:
+        std::copy(output->data.f, output->data.f + face_descriptor_size, descriptor);
+        break;
+      case kTfLiteInt8:
+        dequantizeDescriptor(output->data.int8, output->params, descriptor);
+        break;
+      case kTfLiteUInt8:
+        dequantizeDescriptor(output->data.uint8, output->params, descriptor);
+        break;
+      default:
+        return absl::InvalidArgumentError("Unsupported output type.");
+    }
+    return absl::OkStatus();
+  }
+
+  private:
+  // Builds a fresh interpreter on the XNNPACK delegate; a failed
+  // ModifyGraphWithDelegate leaves the previous one unusable.
+  absl::Status buildInterpreter(int num_threads, bool fp16) {
+    this->interpreter.reset();
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    RET_CHECK_EQ(tflite::InterpreterBuilder(*this->model, resolver)(&this->interpreter), kTfLiteOk);
+
+    TfLiteXNNPackDelegateOptions xnnpack_options = TfLiteXNNPackDelegateOptionsDefault();
+    xnnpack_options.num_threads = num_threads;
+    if (fp16)
+      xnnpack_options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+    this->delegate.reset(TfLiteXNNPackDelegateCreate(&xnnpack_options));
+    RET_CHECK(this->delegate) << "Unable to create the XNNPACK delegate";
+    RET_CHECK_EQ(this->interpreter->ModifyGraphWithDelegate(this->delegate.get()), kTfLiteOk);
+    RET_CHECK_EQ(this->interpreter->AllocateTensors(), kTfLiteOk);
+    return absl::OkStatus();
+  }
+};
+
+bool FaceEmbedderWrapper::initFaceEmbedder(std::string model_file, const FaceEmbedderOptions& options) {
+  delete static_cast<FaceEmbedder*>(this->core_embedder_ptr);
+  this->core_embedder_ptr = static_cast<void*>(new FaceEmbedder());
+  FaceEmbedder& embedder = *(static_cast<FaceEmbedder*>(this->core_embedder_ptr));
+
+  absl::Status status = embedder.initFaceEmbedder(model_file, options);
+  if (!status.ok())
+    std::cerr << "Failed to initialize the face embedder." << status.message() << std::endl;
+
+  return status.ok();
+}
+bool FaceEmbedderWrapper::computeDescriptor(const cv::Mat& face_chip, float* descriptor) {
+  FaceEmbedder& embedder = *(static_cast<FaceEmbedder*>(this->core_embedder_ptr));
+  absl::Status status = embedder.computeDescriptor(face_chip, descriptor);
+  if (!status.ok())
+    std::cerr << "Failed to compute the face descriptor." << status.message() << std::endl;
+
+  return status.ok();
+}
+FaceEmbedderWrapper::~FaceEmbedderWrapper() {
+  delete static_cast<FaceEmbedder*>(this->core_embedder_ptr);
+}
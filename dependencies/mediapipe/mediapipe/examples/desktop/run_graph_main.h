@@ -17,8 +17,10 @@
 #pragma once
 
 #include <cstdlib>
+#include <functional>
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <vector>
 
 // #include "absl/flags/flag.h"
 // #include "absl/flags/parse.h"
@@ -35,6 +37,9 @@
  * For E.A.R.:
  * 133, 158, 160, 33, 144, 153,
  * 362, 285, 387, 263, 373, 380
+ *
+ * For face alignment (dlib's 5 point layout):
+ * 263, 362, 33, 133, 2
  */
 
 enum LandmarkNames {
@@ -55,13 +60,69 @@ enum LandmarkNames {
 	RIGHT_EYE_LOWER_LID_MID_RIGHT_POINT = 14, // 144
 	RIGHT_EYE_LOWER_LID_MID_LEFT_POINT = 15,  // 153
 	LEFT_PUPIL_CENTER = 16,                   // 473
-	RIGHT_PUPIL_CENTER = 17                   // 468
+	RIGHT_PUPIL_CENTER = 17,                  // 468
+	NOSE_BOTTOM = 18                          // 2
 };
 
-const int landmark_converting_table[18]{4, 152, 287, 57, 362, 385, 387, 263, 373, 380, 133, 158, 160, 33, 144, 153, 473, 468};
+const int landmark_count = 19;
+
+// Face mesh (with iris) index of every LandmarkNames entry, picked in the
+// graph by DMSLandmarksCalculator.
+const int landmark_converting_table[landmark_count]{4, 152, 287, 57, 362, 385, 387, 263, 373, 380, 133, 158, 160, 33, 144, 153, 473, 468, 2};
 
 struct DMSLandmarks {
-	cv::Point3d landmarks[18];
+	cv::Point3d landmarks[landmark_count];
+};
+
+enum class MPPGraphBackend {
+	GPU, // iris_tracking_gpu.pbtxt, needs EGL and OpenGL ES 3.2
+	CPU  // iris_tracking_cpu.pbtxt, TFLite on XNNPACK
+};
+
+// Graphs compiled into the library as binary CalculatorGraphConfig protos,
+// so starting one reads and parses no text file.
+enum class MPPGraphConfig {
+	IRIS_TRACKING_GPU,          // iris_tracking_gpu.pbtxt
+	IRIS_TRACKING_GPU_HEADLESS, // iris_tracking_gpu_headless.pbtxt
+	IRIS_TRACKING_CPU,          // iris_tracking_cpu.pbtxt
+	DMS_LANDMARKS_GPU           // dms_landmarks_gpu.pbtxt
+};
+
+struct MPPGraphOptions {
+	// Must match the graph config file passed to `initMPPGraph`.
+	MPPGraphBackend backend = MPPGraphBackend::GPU;
+	// Cores the graph's threads (including the inference threads) are
+	// pinned to. Empty means no pinning.
+	std::vector<int> cpu_cores;
+	// Deliver outputs through `pollResult` instead of blocking in
+	// `processFrame`, so capture and graph execution can overlap.
+	bool async = false;
+	// Run a graph without the renderer (iris_tracking_gpu_headless.pbtxt).
+	// Only landmarks and presence are produced and `output_frame` stays
+	// empty, which skips the GPU readback of the rendered frame.
+	bool headless = false;
+	// Looks up a model file the graph asks for (e.g. "mediapipe/modules/
+	// face_landmark/face_landmark.tflite") and returns false if it has
+	// none. It is asked first, with the path as the graph wrote it: a
+	// file of the same name on disk is neither opened nor memory mapped
+	// unless it returns false, and only then is the path resolved
+	// (bazel-bin/, --resource_root_dir) and read from disk. Empty reads
+	// every model from disk, relative to the working directory.
+	std::function<bool(const std::string& path, std::string& contents)> resource_provider;
+	// Directory to profile the graph into. The MediaPipe profiler and
+	// tracer are turned on and trace_<n>.binarypb files are written for
+	// viz.mediapipe.dev, together with summary.log, which gets per
+	// calculator p50/p95/p99 latency and queueing every
+	// `profile_summary_interval_s`. Empty leaves profiling off.
+	std::string profile_path;
+	int profile_summary_interval_s = 10;
+};
+
+struct MPPGraphResult {
+	size_t timestamp_us;
+	cv::Mat output_frame;
+	DMSLandmarks landmarks;
+	bool landmark_presence;
 };
 
 class MPPGraphRunnerWrapper {
@@ -71,6 +132,21 @@ private:
 public:
 	//   MPPGraphRunnerWrapper() {}
 	~MPPGraphRunnerWrapper();
-	bool initMPPGraph(std::string);
+	bool initMPPGraph(std::string, const MPPGraphOptions& = MPPGraphOptions());
+	// Runs one of the graphs compiled into the library. The DMS-only build
+	// (librun_graph_main_dms_gpu.so) has only DMS_LANDMARKS_GPU and fails
+	// with an error for the others.
+	bool initMPPGraph(MPPGraphConfig, const MPPGraphOptions& = MPPGraphOptions());
+	// `camera_frame` may be either the BGR frame read from cv::VideoCapture
+	// or an RGBA frame. BGR frames are converted while being copied into
+	// the graph's input buffer, so callers should not convert them first.
+	// Also works on a graph initialized in asynchronous mode, as long as
+	// nothing else is submitting frames at the same time.
 	bool processFrame(cv::Mat&, size_t, cv::Mat&, DMSLandmarks&, bool&);
+
+	// Asynchronous mode. `submitFrame` returns as soon as the frame is in
+	// the graph; finished results are picked up with `pollResult`, which
+	// never blocks and returns false if no new result is ready yet.
+	bool submitFrame(cv::Mat&, size_t);
+	bool pollResult(MPPGraphResult&);
 };
@@ -26,6 +26,7 @@
 #include "mediapipe/framework/port/ret_check.h"
 #include "mediapipe/framework/port/status_macros.h"
 #include "mediapipe/util/resource_util.h"
+#include "mediapipe/util/resource_util_custom.h"
 #include "mediapipe/util/tflite/error_reporter.h"
 #include "tensorflow/lite/allocation.h"
 #include "tensorflow/lite/model_builder.h"
@@ -41,7 +42,12 @@ absl::StatusOr<api2::Packet<TfLiteModelPtr>> TfLiteModelLoader::LoadFromPath(
     const std::string& path, bool try_mmap) {
   std::string model_path = path;
 
-  if (!file::Exists(model_path).ok()) {
+  // A custom resource provider gets the path as the graph wrote it, before
+  // any file on disk is looked at or memory mapped, so that it decides
+  // where every model comes from.
+  const bool custom_provider = HasCustomGlobalResourceProvider();
+
+  if (!custom_provider && !file::Exists(model_path).ok()) {
     // TODO: get rid of manual resolving with PathToResourceAsFile
     // as soon as it's incorporated into GetResourceContents.
     MP_ASSIGN_OR_RETURN(model_path,
@@ -51,7 +57,7 @@ absl::StatusOr<api2::Packet<TfLiteModelPtr>> TfLiteModelLoader::LoadFromPath(
 
   // Try to memory map file if available. Falls back to loading from buffer on
   // error.
-  if (try_mmap && MMAPAllocation::IsSupported()) {
+  if (!custom_provider && try_mmap && MMAPAllocation::IsSupported()) {
     ErrorReporter error_reporter;
     std::unique_ptr<Allocation> allocation =
         std::make_unique<MMAPAllocation>(model_path.c_str(), &error_reporter);
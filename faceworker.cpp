@@ -0,0 +1,143 @@
+#include <chrono>
+#include <iostream>
+
+#include "faceworker.h"
+
+#include "include/camera.hpp"
+#include "include/common.hpp"
+#include "include/face_recognizer.hpp"
+#include "run_graph_main.h"
+
+
+FaceWorker::FaceWorker(QObject *parent) : QObject(parent)
+{
+}
+
+void FaceWorker::setCamera(dms::CameraSession *camera)
+{
+    this->camera = camera;
+}
+
+void FaceWorker::setLandmarkGraph(MPPGraphRunnerWrapper *runner)
+{
+    landmark_runner = runner;
+}
+
+void FaceWorker::cancel()
+{
+    cancelled = true;
+}
+
+void FaceWorker::previewShown()
+{
+    preview_pending = false;
+}
+
+void FaceWorker::preview(const cv::Mat &frame)
+{
+    if (frame.empty() || preview_pending.exchange(true))
+        return;
+    cv::Mat rgb;
+    cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+    emit previewReady(QImage(rgb.data, rgb.cols, rgb.rows, static_cast<int>(rgb.step), QImage::Format_RGB888).copy());
+}
+
+
+void FaceWorker::registerDriver()
+{
+    bool flag_regist;
+    int err;
+
+    emit statusChanged("regist button click");
+    if (!camera || !camera->isOpened())
+    {
+       std::cerr << "Unable to connect to camera" << std::endl;
+       emit statusChanged("Unable to connect to camera");
+       emit registrationFinished(false);
+       return;
+    }
+    // 모델은 기다리는 동안 백그라운드에서 로딩
+    dms::FaceModels::preload();
+
+    std::vector<cv::Mat> main_cam_images;
+    QString command[5] = {"카메라를 쳐다보세요", "30도 왼쪽을 보세요", "30도 오른쪽을 보세요", "30도 위를 보세요", "30도 아래를 보세요"};
+    std::vector<cv::Point2d> driver_gaze_angle;
+
+    std::string driver_name; // 비워 두면 DB가 다음 번호로 이름을 붙임
+    cv::Mat img_capture;
+    size_t frame_seq = 0;
+    for (int i = 0; i < 5; i++){
+        emit statusChanged(command[i]);
+        // 2초 동안 미리보기를 계속 보여주다가 마지막 프레임을 찰칵
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (cancelled || !camera->read(img_capture, frame_seq)) {
+                emit registrationFinished(false);
+                return;
+            }
+            preview(img_capture);
+        }
+        main_cam_images.push_back(img_capture.clone());
+    }
+    emit statusChanged("Registering...");
+
+    dms::DriverRegistrar driver_registrar;
+    flag_regist = driver_registrar.registerDriver(main_cam_images,driver_gaze_angle,driver_name,err);
+    if (flag_regist) {
+       std::cout << "등록 성공: " << driver_name << std::endl;
+       emit statusChanged(QString("Successfully registered as driver %1!").arg(QString::fromStdString(driver_name)));
+    }
+    else {
+       std::cout << "등록 실패" << std::endl;
+       emit statusChanged("Registration failed.");
+    }
+    emit registrationFinished(flag_regist);
+}
+
+
+void FaceWorker::authenticateDriver()
+{
+    emit statusChanged("authentic button click");
+
+    if (!camera || !camera->isOpened())
+    {
+        std::cerr << "Unable to connect to camera" << std::endl;
+        emit statusChanged("Unable to connect to camera");
+        emit authenticationFinished(false, QString());
+        return;
+    }
+
+    dms::StreamingAuthenticator streaming_authenticator;
+    dms::StreamingAuthenticator::Decision decision = dms::StreamingAuthenticator::Decision::PENDING;
+
+    // 카메라 프레임을 계속 받아서 확신이 들면 바로 결정 (최대 5초)
+    cv::Mat img_capture;
+    size_t frame_seq = 0;
+    emit statusChanged("Look at the camera");
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (decision == dms::StreamingAuthenticator::Decision::PENDING && !cancelled
+           && std::chrono::steady_clock::now() < deadline && camera->read(img_capture, frame_seq)) {
+        preview(img_capture);
+        if (landmark_runner) {
+            // 랜드마크 그래프로 얼굴 위치를 찾아서 HOG 탐지 생략
+            cv::Mat output_frame;
+            DMSLandmarks landmarks;
+            bool landmark_presence = false;
+            const size_t timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            if (!landmark_runner->processFrame(img_capture, timestamp_us, output_frame, landmarks, landmark_presence))
+                landmark_presence = false;
+            decision = streaming_authenticator.addFrame(img_capture, landmarks, landmark_presence);
+        }
+        else {
+            decision = streaming_authenticator.addFrame(img_capture);
+        }
+    }
+
+    const bool flag_authentic = decision == dms::StreamingAuthenticator::Decision::ACCEPTED;
+    if (flag_authentic)
+        emit statusChanged("Authenticated! Access granted.");
+    else
+        emit statusChanged("Authentication failed. Please try again.");
+    emit authenticationFinished(flag_authentic, QString::fromStdString(streaming_authenticator.driverName()));
+}
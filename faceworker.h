@@ -0,0 +1,58 @@
+#pragma once
+#ifndef FACEWORKER_H
+#define FACEWORKER_H
+
+#include <atomic>
+
+#include <QImage>
+#include <QObject>
+#include <QString>
+
+class MPPGraphRunnerWrapper;
+namespace dms { class CameraSession; }
+
+namespace cv { class Mat; }
+
+// Runs the camera, registration and authentication on its own thread so
+// the window stays responsive. Everything it reports comes back to the
+// window through queued signals.
+class FaceWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FaceWorker(QObject *parent = nullptr);
+
+    // Both must be set before the first registration or authentication
+    // request.
+    void setCamera(dms::CameraSession *camera);
+    void setLandmarkGraph(MPPGraphRunnerWrapper *runner);
+
+    // May be called from any thread. Makes a running registration or
+    // authentication give up at its next frame.
+    void cancel();
+
+    // Called by the window once it has drawn the last preview frame.
+    void previewShown();
+
+public slots:
+    void registerDriver();
+    void authenticateDriver();
+
+signals:
+    void statusChanged(const QString &status);
+    void previewReady(const QImage &frame);
+    void registrationFinished(bool registered);
+    void authenticationFinished(bool authenticated, const QString &driver_name);
+
+private:
+    dms::CameraSession *camera = nullptr;
+    MPPGraphRunnerWrapper *landmark_runner = nullptr;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> preview_pending{false};
+
+    // Hands a frame to the window unless it is still busy drawing the
+    // previous one, so a slow window never backs up the camera loop.
+    void preview(const cv::Mat &frame);
+};
+#endif // FACEWORKER_H
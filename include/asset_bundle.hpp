@@ -0,0 +1,244 @@
+#ifndef ASSET_BUNDLE_HPP
+#define ASSET_BUNDLE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dms {
+	/*
+	Resolves `relative` against the directory of the running executable,
+	so installed files are found no matter where WatchOut is started from.
+	*/
+	inline std::string installPath(const std::string& relative) {
+		char exe[PATH_MAX];
+		const ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+		if (n <= 0) return relative;
+		const std::string exe_path(exe, n);
+		return exe_path.substr(0, exe_path.rfind('/') + 1) + relative;
+	}
+
+	/*
+	On-disk layout of the asset bundle, native endian:
+
+		AssetBundleHeader
+		AssetRecord[num_assets]
+		asset contents, each starting ALIGNMENT aligned
+
+	Assets are named after the file they were packed from, without its
+	directory. The bundle is built once at build time (see pack_assets),
+	so startup maps one file instead of opening every model on its own.
+	*/
+	struct AssetBundleHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_assets;
+		uint64_t size; // of the whole bundle
+	};
+	static_assert(sizeof(AssetBundleHeader) == 24, "unexpected padding in AssetBundleHeader");
+
+	struct AssetRecord {
+		uint64_t offset; // from the start of the bundle
+		uint64_t size;
+		char name[112];  // NUL terminated
+	};
+	static_assert(sizeof(AssetRecord) == 128, "unexpected padding in AssetRecord");
+
+	class AssetBundle {
+		/*
+		A read-only mapping of the asset bundle. Assets are handed out as
+		views into the mapping, so they live as long as the bundle does.
+		*/
+	public:
+		static constexpr char MAGIC[8] = { 'D', 'M', 'S', 'P', 'A', 'K', '\0', '\0' };
+		static constexpr uint32_t VERSION = 1;
+		static constexpr uint64_t ALIGNMENT = 64;
+
+	private:
+		static inline const std::string BUNDLE_PATH = "watchout.assets";
+
+		void* data;
+		size_t size;
+
+		AssetBundle(void* data, const size_t size) : data(data), size(size) {}
+
+		const AssetBundleHeader& header() const {
+			return *static_cast<const AssetBundleHeader*>(data);
+		}
+
+		const AssetRecord& record(const size_t i) const {
+			return reinterpret_cast<const AssetRecord*>(static_cast<const char*>(data) + sizeof(AssetBundleHeader))[i];
+		}
+
+		bool validate() const {
+			const AssetBundleHeader& h = header();
+			if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+			if (h.version != VERSION || h.size != size) return false;
+			if (sizeof(AssetBundleHeader) + uint64_t(h.num_assets) * sizeof(AssetRecord) > size) return false;
+			for (size_t i = 0; i < h.num_assets; i++) {
+				const AssetRecord& r = record(i);
+				if (r.offset > size || r.size > size - r.offset) return false;
+				if (std::memchr(r.name, '\0', sizeof(r.name)) == nullptr) return false;
+			}
+			return true;
+		}
+
+	public:
+		AssetBundle(const AssetBundle&) = delete;
+		AssetBundle& operator=(const AssetBundle&) = delete;
+
+		~AssetBundle() {
+			munmap(data, size);
+		}
+
+		/*
+		Maps `path` read-only. Returns nullptr with `err` set to ENOENT
+		if there is no bundle, or to EBADMSG if it is not a valid one.
+		*/
+		static std::shared_ptr<const AssetBundle> map(const std::string& path, int& err) {
+			const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				err = errno;
+				return nullptr;
+			}
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(AssetBundleHeader))) {
+				::close(fd);
+				err = EBADMSG;
+				return nullptr;
+			}
+			void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (data == MAP_FAILED) {
+				err = errno;
+				return nullptr;
+			}
+			std::shared_ptr<const AssetBundle> bundle(new AssetBundle(data, st.st_size));
+			if (!bundle->validate()) {
+				err = EBADMSG;
+				return nullptr;
+			}
+			err = 0;
+			return bundle;
+		}
+
+		/*
+		The bundle installed next to the executable, mapped on first use.
+		Null if there is none; callers then read the loose files.
+		*/
+		static std::shared_ptr<const AssetBundle> shared() {
+			static const std::shared_ptr<const AssetBundle> bundle = [] {
+				int err;
+				const std::string path = installPath(BUNDLE_PATH);
+				std::shared_ptr<const AssetBundle> mapped = map(path, err);
+				if (!mapped)
+					std::cerr << "Warning: Unable to map " << path << " (" << std::strerror(err) << "), reading loose asset files." << std::endl;
+				return mapped;
+			}();
+			return bundle;
+		}
+
+		/*
+		Packs `files` into a bundle at `path`. Like the driver database, the
+		bundle is written next to `path` and renamed over it.
+		*/
+		static bool pack(const std::string& path, const std::vector<std::string>& files) {
+			std::vector<AssetRecord> records(files.size());
+			std::vector<std::string> contents(files.size());
+			uint64_t offset = sizeof(AssetBundleHeader) + files.size() * sizeof(AssetRecord);
+			for (size_t i = 0; i < files.size(); i++) {
+				std::ifstream ifs(files[i], std::ios::binary);
+				if (!ifs) {
+					std::cerr << "Error: Unable to read " << files[i] << std::endl;
+					return false;
+				}
+				contents[i].assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+				const std::string name = files[i].substr(files[i].rfind('/') + 1);
+				if (name.size() >= sizeof(records[i].name)) {
+					std::cerr << "Error: " << name << " is too long an asset name" << std::endl;
+					return false;
+				}
+				offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+				records[i].offset = offset;
+				records[i].size = contents[i].size();
+				std::strncpy(records[i].name, name.c_str(), sizeof(records[i].name) - 1);
+				offset += contents[i].size();
+			}
+
+			AssetBundleHeader h{};
+			std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+			h.version = VERSION;
+			h.num_assets = static_cast<uint32_t>(files.size());
+			h.size = offset;
+
+			const std::string tmp_path = path + ".tmp";
+			std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+			if (!ofs) return false;
+			ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			ofs.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(AssetRecord));
+			uint64_t written = sizeof(AssetBundleHeader) + records.size() * sizeof(AssetRecord);
+			for (size_t i = 0; i < files.size(); i++) {
+				const std::string padding(records[i].offset - written, '\0');
+				ofs.write(padding.data(), padding.size());
+				ofs.write(contents[i].data(), contents[i].size());
+				written = records[i].offset + records[i].size;
+			}
+			ofs.close();
+			if (!ofs) {
+				std::remove(tmp_path.c_str());
+				return false;
+			}
+			return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+		}
+
+		uint32_t numAssets() const { return header().num_assets; }
+
+		// Contents of the asset called `name`; empty if there is none.
+		std::string_view find(const std::string& name) const {
+			for (size_t i = 0; i < numAssets(); i++) {
+				const AssetRecord& r = record(i);
+				if (name == r.name)
+					return std::string_view(static_cast<const char*>(data) + r.offset, r.size);
+			}
+			return std::string_view();
+		}
+	};
+
+	class AssetStream : public std::istream {
+		/*
+		Reads an asset in place, for loaders that take a stream such as
+		dlib::deserialize. Keep the bundle alive while reading.
+		*/
+	private:
+		struct Buffer : public std::streambuf {
+			explicit Buffer(const std::string_view asset) {
+				// The get area is never written to; std::streambuf just
+				// has no const flavour.
+				char* begin = const_cast<char*>(asset.data());
+				setg(begin, begin, begin + asset.size());
+			}
+		} buffer;
+
+	public:
+		explicit AssetStream(const std::string_view asset) : std::istream(nullptr), buffer(asset) {
+			rdbuf(&buffer);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "stage_timer.hpp"
+
+namespace dms {
+	class CameraSession {
+		/*
+		Opens the camera once and keeps grabbing frames on its own thread
+		for as long as it lives, so authentication and monitoring share
+		one open device and always start from a fresh frame.
+
+		Readers get the newest frame by reference, not by copy. A frame
+		buffer is only reused for capture once no reader holds it any more,
+		so readers must not draw on the frames they get.
+		*/
+	private:
+		cv::VideoCapture capture;
+		std::thread grabber;
+		std::mutex m;
+		std::condition_variable frame_cv;
+		cv::Mat latest;
+		size_t latest_seq;
+		bool running;
+
+		void grab() {
+			cv::Mat frame;
+			while (true) {
+				{
+					std::lock_guard<std::mutex> lock(this->m);
+					if (!this->running) return;
+				}
+				// Don't overwrite a buffer a reader still refers to.
+				if (frame.u != nullptr && frame.u->refcount > 1)
+					frame.release();
+				bool ok;
+				{
+					ScopedStageTimer timer(Stage::CAPTURE);
+					ok = this->capture.read(frame);
+				}
+				{
+					std::lock_guard<std::mutex> lock(this->m);
+					if (!ok) {
+						this->running = false;
+					}
+					else {
+						std::swap(this->latest, frame);
+						this->latest_seq++;
+					}
+				}
+				this->frame_cv.notify_all();
+				if (!ok) return;
+			}
+		}
+
+	public:
+		explicit CameraSession(const int device = 0) : capture(device), latest_seq(0), running(false) {
+			// capture.set(cv::CAP_PROP_FRAME_WIDTH, 240);
+			// capture.set(cv::CAP_PROP_FRAME_HEIGHT, 240);
+			if (!this->capture.isOpened()) return;
+			this->running = true;
+			this->grabber = std::thread(&CameraSession::grab, this);
+		}
+
+		CameraSession(const CameraSession&) = delete;
+		CameraSession& operator=(const CameraSession&) = delete;
+
+		~CameraSession() {
+			{
+				std::lock_guard<std::mutex> lock(this->m);
+				this->running = false;
+			}
+			if (this->grabber.joinable())
+				this->grabber.join();
+			this->capture.release();
+		}
+
+		bool isOpened() {
+			std::lock_guard<std::mutex> lock(this->m);
+			return this->running;
+		}
+
+		/*
+		Waits for a frame newer than `seq` (0 to take whatever is there)
+		and updates `seq` to it. Returns false if the camera is closed or
+		no frame came within `timeout`.
+		*/
+		bool read(cv::Mat& frame, size_t& seq, const std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) {
+			std::unique_lock<std::mutex> lock(this->m);
+			if (!this->frame_cv.wait_for(lock, timeout, [&] { return this->latest_seq > seq || !this->running; }))
+				return false;
+			if (this->latest_seq <= seq) return false;
+			frame = this->latest;
+			seq = this->latest_seq;
+			return true;
+		}
+	};
+}
+
+#endif
@@ -1,9 +1,15 @@
 #ifndef COMMON_HPP
 #define COMMON_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <string>
 #include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include <dlib/dnn.h>
 #include <dlib/matrix.h>
@@ -20,6 +26,147 @@ namespace dms {
 		_Ty& value() { return this->v; }
 	};
 
+	template <typename _Ty>
+	class TripleBuffer {
+	/*
+	Hands the latest value of `_Ty` from one writer thread to one
+	reader thread. Both sides are wait-free: the writer fills its own
+	slot and swaps it with the shared middle slot, the reader swaps
+	the middle slot with its own only if something new was published.
+	Values published between two reads are overwritten, so this is for
+	state where only the newest value matters (unlike `Channel`).
+	*/
+	private:
+		static constexpr unsigned FRESH = 4; // Set while the middle slot holds an unread value
+
+		_Ty slots[3]{};
+		alignas(64) std::atomic<unsigned> middle{1};
+		alignas(64) unsigned back = 0; // Writer's slot
+		alignas(64) unsigned front = 2; // Reader's slot
+
+	public:
+		/*
+		Writer side. Fill the slot returned by `writeBuffer` and then
+		`publish` it, or do both with `write`.
+		*/
+		_Ty& writeBuffer() { return this->slots[this->back]; }
+		void publish() {
+			this->back = this->middle.exchange(this->back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+		}
+		void write(const _Ty& value) {
+			this->writeBuffer() = value;
+			this->publish();
+		}
+
+		/*
+		Reader side. Returns the most recently published value, or a
+		default constructed one if nothing was published yet. The
+		reference stays valid until the next call to `read`.
+		*/
+		const _Ty& read() {
+			if (this->middle.load(std::memory_order_relaxed) & FRESH)
+				this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & ~FRESH;
+			return this->slots[this->front];
+		}
+	};
+
+	template <typename _Ty, size_t N = 8>
+	class Channel {
+	/*
+	Bounded single-producer/single-consumer channel.
+
+	`push` never blocks: if the consumer has fallen N-1 values behind,
+	the new value is dropped. `pop` blocks until a value arrives or the
+	channel is closed. The mutex is only touched when the consumer is
+	actually asleep, so a busy consumer costs the producer nothing.
+	*/
+	private:
+		std::array<_Ty, N> slots;
+		std::atomic<size_t> head{0};
+		std::atomic<size_t> tail{0};
+		std::atomic<bool> closed{false};
+		std::atomic<bool> waiting{false};
+		std::mutex m;
+		std::condition_variable cv;
+
+		inline bool tryPop(_Ty& value);
+		inline void wake();
+
+	public:
+		/*
+		Returns false if the value was dropped.
+		*/
+		inline bool push(const _Ty& value);
+
+		/*
+		Returns false once the channel is closed and drained.
+		*/
+		inline bool pop(_Ty& value);
+
+		/*
+		Wakes up the consumer for good. Values already pushed can
+		still be popped.
+		*/
+		inline void close();
+	};
+
+	template <typename _Ty, size_t N>
+	inline bool Channel<_Ty, N>::push(const _Ty& value) {
+		const size_t t = this->tail.load(std::memory_order_relaxed);
+		const size_t next = (t + 1) % N;
+		if (next == this->head.load(std::memory_order_acquire))
+			return false;
+
+		this->slots[t] = value;
+		this->tail.store(next, std::memory_order_seq_cst);
+		this->wake();
+		return true;
+	}
+
+	template <typename _Ty, size_t N>
+	inline bool Channel<_Ty, N>::pop(_Ty& value) {
+		while (true) {
+			if (this->tryPop(value))
+				return true;
+			if (this->closed.load())
+				return this->tryPop(value);
+
+			std::unique_lock<std::mutex> ul(this->m);
+			this->waiting.store(true, std::memory_order_seq_cst);
+			this->cv.wait(ul, [this]() {
+				return this->head.load(std::memory_order_relaxed) != this->tail.load(std::memory_order_seq_cst) ||
+				       this->closed.load();
+			});
+			this->waiting.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	template <typename _Ty, size_t N>
+	inline void Channel<_Ty, N>::close() {
+		this->closed.store(true);
+		std::lock_guard<std::mutex> lg(this->m);
+		this->cv.notify_one();
+	}
+
+	template <typename _Ty, size_t N>
+	inline bool Channel<_Ty, N>::tryPop(_Ty& value) {
+		const size_t h = this->head.load(std::memory_order_relaxed);
+		if (h == this->tail.load(std::memory_order_acquire))
+			return false;
+
+		value = this->slots[h];
+		this->head.store((h + 1) % N, std::memory_order_release);
+		return true;
+	}
+
+	template <typename _Ty, size_t N>
+	inline void Channel<_Ty, N>::wake() {
+		if (this->waiting.load(std::memory_order_seq_cst)) {
+			std::lock_guard<std::mutex> lg(this->m);
+			this->cv.notify_one();
+		}
+	}
+
 	class Rate {
 	/*
 	This class is a tool for syncing loop and calculate
@@ -73,6 +220,54 @@ namespace dms {
 		this->next = std::chrono::steady_clock::now() + this->interval;
 	}
 
+	class LatencyStats {
+	/*
+	Collects latency samples of one stage of the pipeline and
+	reports their percentiles. Every sample is kept, so this is
+	meant for bounded runs such as the offline replay benchmark.
+	*/
+	private:
+		std::vector<double> samples; // milliseconds, unless added as plain values
+		bool sorted = true;
+
+	public:
+		inline void add(const std::chrono::steady_clock::duration latency);
+
+		/*
+		Adds a sample in any unit, e.g. an error to report
+		percentiles of.
+		*/
+		inline void add(const double sample);
+
+		/*
+		`p` is in [0, 100]. Returns 0 if no sample was added.
+		*/
+		inline double percentile(const double p);
+
+		size_t count() const { return this->samples.size(); }
+	};
+
+	inline void LatencyStats::add(const std::chrono::steady_clock::duration latency) {
+		this->add(std::chrono::duration<double, std::milli>(latency).count());
+	}
+
+	inline void LatencyStats::add(const double sample) {
+		this->samples.push_back(sample);
+		this->sorted = false;
+	}
+
+	inline double LatencyStats::percentile(const double p) {
+		if (this->samples.empty())
+			return 0;
+		if (!this->sorted) {
+			std::sort(this->samples.begin(), this->samples.end());
+			this->sorted = true;
+		}
+
+		size_t rank = static_cast<size_t>(p / 100 * (this->samples.size() - 1) + 0.5);
+		return this->samples[std::min(rank, this->samples.size() - 1)];
+	}
+
 	struct GazeAngle {
 		/*
 		Custom data type to hold driver's gaze. `yaw` and
@@ -0,0 +1,225 @@
+#ifndef DESCRIPTOR_MATCHER_HPP
+#define DESCRIPTOR_MATCHER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DMS_MATCHER_NEON
+#elif defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#define DMS_MATCHER_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DMS_MATCHER_SSE
+#endif
+
+namespace dms {
+	// Rows [first, first + count) of the descriptors that belong to one driver
+	struct DescriptorRange {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	class DescriptorMatcher {
+		/*
+		Nearest-driver search over 128-D face descriptors.
+
+		Descriptors are kept in blocks of BLOCK: within a block, element
+		k of all BLOCK descriptors is contiguous, so one pass over a block
+		computes BLOCK squared distances with the query element broadcast
+		and every load is sequential. The last block is zero padded.
+		*/
+	public:
+		static constexpr size_t DIM = 128;
+		static constexpr size_t BLOCK = 16;
+		static constexpr size_t ALIGNMENT = 32;
+
+		enum class Aggregation {
+			MEAN, // Mean distance of a driver's k nearest descriptors
+			MIN   // Distance of a driver's nearest descriptor
+		};
+
+		struct Match {
+			size_t driver; // Index into the ranges the matcher was built with
+			float distance; // Euclidean
+		};
+
+	private:
+		struct AlignedFree {
+			void operator()(float* p) const { std::free(p); }
+		};
+
+		size_t num_descriptors;
+		size_t num_blocks;
+		std::unique_ptr<float[], AlignedFree> blocks;
+		std::vector<DescriptorRange> ranges;
+
+		static void squaredDistancesBlock(const float* block, const float* query, float* out) {
+#if defined(DMS_MATCHER_NEON)
+			float32x4_t acc0 = vdupq_n_f32(0.f), acc1 = vdupq_n_f32(0.f);
+			float32x4_t acc2 = vdupq_n_f32(0.f), acc3 = vdupq_n_f32(0.f);
+			for (size_t k = 0; k < DIM; k++, block += BLOCK) {
+				const float32x4_t q = vdupq_n_f32(query[k]);
+				const float32x4_t d0 = vsubq_f32(vld1q_f32(block), q);
+				const float32x4_t d1 = vsubq_f32(vld1q_f32(block + 4), q);
+				const float32x4_t d2 = vsubq_f32(vld1q_f32(block + 8), q);
+				const float32x4_t d3 = vsubq_f32(vld1q_f32(block + 12), q);
+#if defined(__aarch64__)
+				acc0 = vfmaq_f32(acc0, d0, d0);
+				acc1 = vfmaq_f32(acc1, d1, d1);
+				acc2 = vfmaq_f32(acc2, d2, d2);
+				acc3 = vfmaq_f32(acc3, d3, d3);
+#else
+				acc0 = vmlaq_f32(acc0, d0, d0);
+				acc1 = vmlaq_f32(acc1, d1, d1);
+				acc2 = vmlaq_f32(acc2, d2, d2);
+				acc3 = vmlaq_f32(acc3, d3, d3);
+#endif
+			}
+			vst1q_f32(out, acc0);
+			vst1q_f32(out + 4, acc1);
+			vst1q_f32(out + 8, acc2);
+			vst1q_f32(out + 12, acc3);
+#elif defined(DMS_MATCHER_AVX)
+			// Even and odd k go to separate accumulators to hide the add latency.
+			__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+			__m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+			for (size_t k = 0; k < DIM; k += 2, block += 2 * BLOCK) {
+				const __m256 q0 = _mm256_set1_ps(query[k]);
+				const __m256 q1 = _mm256_set1_ps(query[k + 1]);
+				const __m256 d0 = _mm256_sub_ps(_mm256_load_ps(block), q0);
+				const __m256 d1 = _mm256_sub_ps(_mm256_load_ps(block + 8), q0);
+				const __m256 d2 = _mm256_sub_ps(_mm256_load_ps(block + BLOCK), q1);
+				const __m256 d3 = _mm256_sub_ps(_mm256_load_ps(block + BLOCK + 8), q1);
+#if defined(__FMA__)
+				acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+				acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+				acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+				acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+#else
+				acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+				acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+				acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(d2, d2));
+				acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(d3, d3));
+#endif
+			}
+			_mm256_storeu_ps(out, _mm256_add_ps(acc0, acc2));
+			_mm256_storeu_ps(out + 8, _mm256_add_ps(acc1, acc3));
+#elif defined(DMS_MATCHER_SSE)
+			__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+			__m128 acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+			for (size_t k = 0; k < DIM; k++, block += BLOCK) {
+				const __m128 q = _mm_set1_ps(query[k]);
+				const __m128 d0 = _mm_sub_ps(_mm_load_ps(block), q);
+				const __m128 d1 = _mm_sub_ps(_mm_load_ps(block + 4), q);
+				const __m128 d2 = _mm_sub_ps(_mm_load_ps(block + 8), q);
+				const __m128 d3 = _mm_sub_ps(_mm_load_ps(block + 12), q);
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+				acc2 = _mm_add_ps(acc2, _mm_mul_ps(d2, d2));
+				acc3 = _mm_add_ps(acc3, _mm_mul_ps(d3, d3));
+			}
+			_mm_storeu_ps(out, acc0);
+			_mm_storeu_ps(out + 4, acc1);
+			_mm_storeu_ps(out + 8, acc2);
+			_mm_storeu_ps(out + 12, acc3);
+#else
+			float acc[BLOCK] = {};
+			for (size_t k = 0; k < DIM; k++, block += BLOCK) {
+				for (size_t i = 0; i < BLOCK; i++) {
+					const float d = block[i] - query[k];
+					acc[i] += d * d;
+				}
+			}
+			std::memcpy(out, acc, sizeof(acc));
+#endif
+		}
+
+	public:
+		/*
+		Copies `num_descriptors` row-major descriptors into the blocked
+		layout. `ranges` says which rows belong to which driver.
+		*/
+		DescriptorMatcher(const float* descriptors, const size_t num_descriptors, std::vector<DescriptorRange> ranges)
+			: num_descriptors(num_descriptors),
+			  num_blocks((num_descriptors + BLOCK - 1) / BLOCK),
+			  blocks(),
+			  ranges(std::move(ranges)) {
+			if (num_blocks == 0) return;
+			const size_t block_size = BLOCK * DIM;
+			blocks.reset(static_cast<float*>(std::aligned_alloc(ALIGNMENT, num_blocks * block_size * sizeof(float))));
+			if (!blocks) throw std::bad_alloc();
+			std::fill(blocks.get(), blocks.get() + num_blocks * block_size, 0.f);
+			for (size_t n = 0; n < num_descriptors; n++) {
+				float* block = blocks.get() + (n / BLOCK) * block_size + n % BLOCK;
+				const float* row = descriptors + n * DIM;
+				for (size_t k = 0; k < DIM; k++)
+					block[k * BLOCK] = row[k];
+			}
+		}
+
+		DescriptorMatcher(const DescriptorMatcher&) = delete;
+		DescriptorMatcher& operator=(const DescriptorMatcher&) = delete;
+
+		size_t size() const { return num_descriptors; }
+
+		// Size `distances` must have for squaredDistances()
+		size_t paddedSize() const { return num_blocks * BLOCK; }
+
+		/*
+		Squared L2 distance from `query` to every descriptor, in row order.
+		Entries past size() belong to the padding and are meaningless.
+		*/
+		void squaredDistances(const float* query, float* distances) const {
+			const float* block = blocks.get();
+			for (size_t b = 0; b < num_blocks; b++, block += BLOCK * DIM)
+				squaredDistancesBlock(block, query, distances + b * BLOCK);
+		}
+
+		/*
+		Scores every driver by its `k` nearest descriptors (all of them if
+		`k` is 0) and returns the drivers best first.
+		*/
+		std::vector<Match> match(const float* query, const size_t k, const Aggregation aggregation) const {
+			std::vector<float> distances(paddedSize());
+			squaredDistances(query, distances.data());
+
+			std::vector<Match> matches;
+			matches.reserve(ranges.size());
+			for (size_t i = 0; i < ranges.size(); i++) {
+				float* first = distances.data() + ranges[i].first;
+				float* last = first + ranges[i].count;
+				if (first == last) continue;
+				float distance;
+				if (aggregation == Aggregation::MIN) {
+					distance = std::sqrt(*std::min_element(first, last));
+				}
+				else {
+					if (k != 0 && k < ranges[i].count) {
+						std::nth_element(first, first + k, last);
+						last = first + k;
+					}
+					float sum = 0.f;
+					for (float* d = first; d != last; d++)
+						sum += std::sqrt(*d);
+					distance = sum / (last - first);
+				}
+				matches.push_back({ i, distance });
+			}
+			std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+				return a.distance < b.distance;
+			});
+			return matches;
+		}
+	};
+}
+
+#endif
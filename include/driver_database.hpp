@@ -0,0 +1,396 @@
+#ifndef DRIVER_DATABASE_HPP
+#define DRIVER_DATABASE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <dlib/matrix.h>
+
+#include "asset_bundle.hpp"
+#include "descriptor_matcher.hpp"
+
+namespace dms {
+	/*
+	On-disk layout of the driver embedding store, native endian:
+
+		EmbeddingStoreHeader
+		float[num_vectors][DIM]          all descriptors, grouped by driver
+		DriverRecord[num_drivers]        which rows belong to which driver
+
+	`checksum` is FNV-1a over everything after the header. Registration
+	only ever appends: existing rows and records are copied unchanged and
+	the new driver's rows and record go after them.
+	*/
+	struct EmbeddingStoreHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t dim;
+		uint32_t num_drivers;
+		uint32_t num_vectors;
+		uint64_t checksum;
+	};
+	static_assert(sizeof(EmbeddingStoreHeader) == 32, "the descriptor matrix must start 32-byte aligned");
+
+	struct DriverRecord {
+		static constexpr size_t MAX_NAME_LENGTH = 55;
+
+		uint32_t first_vector;
+		uint32_t num_vectors;
+		char name[MAX_NAME_LENGTH + 1]; // NUL terminated, unique within a store
+	};
+	static_assert(sizeof(DriverRecord) == 64, "unexpected padding in DriverRecord");
+
+	class EmbeddingStore {
+		/*
+		A read-only mapping of the embedding store. Never changes once
+		mapped; registration writes a new file and maps that instead.
+		*/
+	public:
+		static constexpr char MAGIC[8] = { 'D', 'M', 'S', 'E', 'M', 'B', '\0', '\0' };
+		static constexpr uint32_t VERSION = 1;
+		static constexpr uint32_t DIM = 128;
+
+	private:
+		void* data;
+		size_t size;
+		std::unique_ptr<const DescriptorMatcher> descriptor_matcher;
+
+		EmbeddingStore(void* data, const size_t size) : data(data), size(size), descriptor_matcher() {}
+
+		const EmbeddingStoreHeader& header() const {
+			return *static_cast<const EmbeddingStoreHeader*>(data);
+		}
+
+		static bool writeAll(const int fd, const void* bytes, size_t size) {
+			const char* b = static_cast<const char*>(bytes);
+			while (size > 0) {
+				const ssize_t n = ::write(fd, b, size);
+				if (n < 0 && errno == EINTR) continue;
+				if (n <= 0) return false;
+				b += n;
+				size -= n;
+			}
+			return true;
+		}
+
+		// Makes a rename in the directory of `path` survive a power loss.
+		static bool syncDirectory(const std::string& path) {
+			const size_t slash = path.rfind('/');
+			const std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+			const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0) return false;
+			const bool synced = fsync(fd) == 0;
+			::close(fd);
+			return synced;
+		}
+
+		static uint64_t checksum(const char* bytes, const size_t size) {
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= static_cast<unsigned char>(bytes[i]);
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		bool validate() const {
+			if (size < sizeof(EmbeddingStoreHeader)) return false;
+			const EmbeddingStoreHeader& h = header();
+			if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+			if (h.version != VERSION || h.dim != DIM) return false;
+			const size_t expected = sizeof(EmbeddingStoreHeader)
+				+ size_t(h.num_vectors) * DIM * sizeof(float)
+				+ size_t(h.num_drivers) * sizeof(DriverRecord);
+			if (size != expected) return false;
+			for (size_t i = 0; i < h.num_drivers; i++) {
+				const DriverRecord& r = driver(i);
+				if (r.num_vectors == 0 || uint64_t(r.first_vector) + r.num_vectors > h.num_vectors) return false;
+				if (std::memchr(r.name, '\0', sizeof(r.name)) == nullptr) return false;
+			}
+			const char* payload = static_cast<const char*>(data) + sizeof(EmbeddingStoreHeader);
+			return checksum(payload, size - sizeof(EmbeddingStoreHeader)) == h.checksum;
+		}
+
+	public:
+		EmbeddingStore(const EmbeddingStore&) = delete;
+		EmbeddingStore& operator=(const EmbeddingStore&) = delete;
+
+		~EmbeddingStore() {
+			munmap(data, size);
+		}
+
+		/*
+		Maps `path` read-only. Returns nullptr with `err` set to ENOENT
+		if there is no store yet, or to EBADMSG if it is not a valid one.
+		*/
+		static std::shared_ptr<const EmbeddingStore> map(const std::string& path, int& err) {
+			const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				err = errno;
+				return nullptr;
+			}
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(EmbeddingStoreHeader))) {
+				::close(fd);
+				err = EBADMSG;
+				return nullptr;
+			}
+			void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (data == MAP_FAILED) {
+				err = errno;
+				return nullptr;
+			}
+			std::shared_ptr<EmbeddingStore> store(new EmbeddingStore(data, st.st_size));
+			if (!store->validate()) {
+				err = EBADMSG;
+				return nullptr;
+			}
+			std::vector<DescriptorRange> ranges(store->numDrivers());
+			for (size_t i = 0; i < ranges.size(); i++)
+				ranges[i] = { store->driver(i).first_vector, store->driver(i).num_vectors };
+			store->descriptor_matcher.reset(
+				new DescriptorMatcher(store->vectors(), store->numVectors(), std::move(ranges)));
+			err = 0;
+			return store;
+		}
+
+		/*
+		Writes `base` (may be null) plus one more driver to `path`. The
+		file is written next to `path`, synced, and renamed over it, then
+		the directory is synced, so mappings of the old store stay valid
+		and after a crash or power loss `path` holds either store whole.
+		*/
+		static bool append(const std::string& path, const EmbeddingStore* base,
+			const std::string& name, const std::vector<dlib::matrix<float, 0, 1>>& emb_vecs) {
+			if (emb_vecs.empty()) return false;
+			for (const auto& v : emb_vecs) {
+				if (static_cast<uint32_t>(v.size()) != DIM) return false;
+			}
+			const uint32_t old_drivers = base ? base->numDrivers() : 0;
+			const uint32_t old_vectors = base ? base->numVectors() : 0;
+
+			std::vector<char> payload;
+			payload.reserve((size_t(old_vectors) + emb_vecs.size()) * DIM * sizeof(float)
+				+ (size_t(old_drivers) + 1) * sizeof(DriverRecord));
+			const auto put = [&payload](const void* bytes, const size_t n) {
+				const char* b = static_cast<const char*>(bytes);
+				payload.insert(payload.end(), b, b + n);
+			};
+			if (base) put(base->vectors(), size_t(old_vectors) * DIM * sizeof(float));
+			for (const auto& v : emb_vecs) put(v.begin(), DIM * sizeof(float));
+			if (base) put(&base->driver(0), size_t(old_drivers) * sizeof(DriverRecord));
+			DriverRecord record{};
+			record.first_vector = old_vectors;
+			record.num_vectors = static_cast<uint32_t>(emb_vecs.size());
+			std::strncpy(record.name, name.c_str(), sizeof(record.name) - 1);
+			put(&record, sizeof(record));
+
+			EmbeddingStoreHeader h{};
+			std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+			h.version = VERSION;
+			h.dim = DIM;
+			h.num_drivers = old_drivers + 1;
+			h.num_vectors = old_vectors + record.num_vectors;
+			h.checksum = checksum(payload.data(), payload.size());
+
+			const std::string tmp_path = path + ".tmp";
+			const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd < 0) return false;
+			const bool written = writeAll(fd, &h, sizeof(h))
+				&& writeAll(fd, payload.data(), payload.size())
+				&& fsync(fd) == 0;
+			if (::close(fd) != 0 || !written || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+				std::remove(tmp_path.c_str());
+				return false;
+			}
+			// The new store is in place either way; only its durability is in doubt.
+			if (!syncDirectory(path))
+				std::cerr << "Warning: Unable to sync the directory of " << path << "." << std::endl;
+			return true;
+		}
+
+		uint32_t numDrivers() const { return header().num_drivers; }
+		uint32_t numVectors() const { return header().num_vectors; }
+
+		// Row-major [numVectors()][DIM] matrix of every descriptor
+		const float* vectors() const {
+			return reinterpret_cast<const float*>(static_cast<const char*>(data) + sizeof(EmbeddingStoreHeader));
+		}
+
+		const float* vector(const size_t i) const {
+			return vectors() + i * DIM;
+		}
+
+		// Search structure over vectors(); a match's `driver` indexes driver()
+		const DescriptorMatcher& matcher() const {
+			return *descriptor_matcher;
+		}
+
+		const DriverRecord& driver(const size_t i) const {
+			const char* records = reinterpret_cast<const char*>(vectors() + size_t(numVectors()) * DIM);
+			return reinterpret_cast<const DriverRecord*>(records)[i];
+		}
+
+		// Index of the driver called `name`, or -1
+		int findDriver(const std::string& name) const {
+			for (uint32_t i = 0; i < numDrivers(); i++) {
+				if (name == driver(i).name) return static_cast<int>(i);
+			}
+			return -1;
+		}
+	};
+
+	class DriverDatabase {
+		/*
+		The registered drivers. Readers take a snapshot and search it
+		without touching the filesystem; registration appends a driver
+		and swaps in the new mapping.
+		*/
+	private:
+		static inline const std::string DATABASE_PATH = "../drivers/drivers.emb"; // Relative to the executable
+		static constexpr int LEGACY_SLOTS = 4;
+		static constexpr size_t LEGACY_MAX_VECTORS = 1024;
+
+		const std::string path;
+		std::mutex mutex;
+		std::shared_ptr<const EmbeddingStore> store;
+		bool writable; // false if an existing file could not be read; never overwrite it
+
+		// Reads one <n>.bin file of the old per-driver format.
+		static bool readLegacyDriver(const std::string& bin_path, std::vector<dlib::matrix<float, 0, 1>>& emb_vecs) {
+			std::ifstream ifs(bin_path, std::ios::binary);
+			if (!ifs) return false;
+			size_t num_embedding_vectors = 0;
+			ifs.read(reinterpret_cast<char*>(&num_embedding_vectors), sizeof(num_embedding_vectors));
+			if (!ifs || num_embedding_vectors == 0 || num_embedding_vectors > LEGACY_MAX_VECTORS) return false;
+			emb_vecs.resize(num_embedding_vectors);
+			for (auto& descriptor : emb_vecs) {
+				size_t num_rows = 0, num_cols = 0;
+				ifs.read(reinterpret_cast<char*>(&num_rows), sizeof(num_rows));
+				ifs.read(reinterpret_cast<char*>(&num_cols), sizeof(num_cols));
+				if (!ifs || num_rows * num_cols != EmbeddingStore::DIM) return false;
+				descriptor.set_size(EmbeddingStore::DIM);
+				ifs.read(reinterpret_cast<char*>(descriptor.begin()), EmbeddingStore::DIM * sizeof(float));
+				if (!ifs) return false;
+			}
+			return true;
+		}
+
+		/*
+		Drivers registered before the embedding store were kept one per
+		file, as <n>.bin next to it: a size_t descriptor count, then for
+		every descriptor its size_t row and column counts and its floats.
+		Imports them, named after their file, into a new store at `path`.
+		The old files are left in place.
+		*/
+		static std::shared_ptr<const EmbeddingStore> importLegacyDrivers(const std::string& path) {
+			const std::string dir = path.substr(0, path.rfind('/') + 1);
+			std::shared_ptr<const EmbeddingStore> imported;
+			for (int slot = 1; slot <= LEGACY_SLOTS; slot++) {
+				const std::string bin_path = dir + std::to_string(slot) + ".bin";
+				std::vector<dlib::matrix<float, 0, 1>> emb_vecs;
+				if (!readLegacyDriver(bin_path, emb_vecs)) continue;
+				int err;
+				if (!EmbeddingStore::append(path, imported.get(), std::to_string(slot), emb_vecs)
+					|| !(imported = EmbeddingStore::map(path, err))) {
+					std::cerr << "Error: Unable to import " << bin_path << " into " << path << "." << std::endl;
+					break;
+				}
+				std::cout << "Imported " << bin_path << " into " << path << "." << std::endl;
+			}
+			return imported;
+		}
+
+	public:
+		explicit DriverDatabase(const std::string& path) : path(path), writable(true) {
+			int err;
+			store = EmbeddingStore::map(path, err);
+			if (store) return;
+			if (err == ENOENT) {
+				store = importLegacyDrivers(path);
+			}
+			else if (err == EBADMSG) {
+				// Keep the damaged file for inspection, but don't let it stop
+				// the vehicle from registering drivers ever again.
+				const std::string corrupt_path = path + ".corrupt";
+				if (std::rename(path.c_str(), corrupt_path.c_str()) == 0) {
+					std::cerr << "Warning: " << path << " is not a valid driver database, moved it to "
+						<< corrupt_path << " and starting with no registered drivers." << std::endl;
+				}
+				else {
+					std::cerr << "Error: " << path << " is not a valid driver database and could not be moved aside ("
+						<< std::strerror(errno) << ")." << std::endl;
+					writable = false;
+				}
+			}
+			else {
+				std::cerr << "Error: Unable to read the driver database " << path << " (" << std::strerror(err) << ")." << std::endl;
+				writable = false;
+			}
+		}
+
+		static DriverDatabase& shared() {
+			static DriverDatabase database(installPath(DATABASE_PATH));
+			return database;
+		}
+
+		// Null if no driver has been registered yet
+		std::shared_ptr<const EmbeddingStore> snapshot() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return store;
+		}
+
+		/*
+		Registers a new driver and returns its id, the index of its
+		DriverRecord. An empty `name` gets the lowest number from
+		numDrivers() + 1 up that no driver is called yet, the scheme the
+		imported drivers are named by. Returns -EEXIST if a driver already
+		has the name, -ENAMETOOLONG if it does not fit a DriverRecord and
+		-EIO if the store could not be written.
+		*/
+		int append(std::string name, const std::vector<dlib::matrix<float, 0, 1>>& emb_vecs) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!writable) return -EIO;
+			if (name.empty()) {
+				for (uint32_t n = (store ? store->numDrivers() : 0) + 1; name.empty(); n++) {
+					if (!store || store->findDriver(std::to_string(n)) < 0)
+						name = std::to_string(n);
+				}
+			}
+			else if (name.size() > DriverRecord::MAX_NAME_LENGTH) {
+				std::cerr << "Error: The driver name \"" << name << "\" is longer than "
+					<< DriverRecord::MAX_NAME_LENGTH << " bytes." << std::endl;
+				return -ENAMETOOLONG;
+			}
+			else if (store && store->findDriver(name) >= 0) {
+				std::cerr << "Error: A driver called \"" << name << "\" is already registered." << std::endl;
+				return -EEXIST;
+			}
+			if (!EmbeddingStore::append(path, store.get(), name, emb_vecs)) return -EIO;
+			int err;
+			std::shared_ptr<const EmbeddingStore> appended = EmbeddingStore::map(path, err);
+			if (!appended) {
+				std::cerr << "Error: Unable to map " << path << " (" << std::strerror(err) << ")." << std::endl;
+				return -EIO;
+			}
+			store = std::move(appended);
+			return static_cast<int>(store->numDrivers()) - 1;
+		}
+	};
+}
+
+#endif
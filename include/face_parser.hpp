@@ -1,22 +1,83 @@
 #ifndef FACE_PARSER_HPP
 #define FACE_PARSER_HPP
 
+#include <algorithm>
+#include <array>
+#include <cfloat>
 #include <cstdlib>
 #include <iostream>
 
 #include <opencv2/opencv.hpp>
 
 #include "common.hpp"
+#include "pose_refiner.hpp"
 #include "run_graph_main.h"
 
 #define PI 3.14159265358979323846
 
 namespace dms {
+	enum class GazeMode {
+		AFFINE,  // Map pupils into model space with estimateAffine3D (RANSAC) on the face landmarks
+		ANALYTIC // Back-project pupils onto the eyeballs with the head pose from solvePnP
+	};
+
 	class GazeEstimator {
 		/*
 		Estimate driver's gaze given facial landmarks.
+
+		All per-frame math works on fixed-size cv::Matx/cv::Vec values
+		and std::arrays, the face model is constant data and the camera
+		matrix is only rebuilt when the frame size changes. Once a head
+		pose is known it is refined on the stack (refinePose) instead of
+		with cv::solvePnP, which is only run on the first frame, after
+		reset() and after an error jump. cv::estimateAffine3D (RANSAC)
+		runs on every GazeMode::AFFINE frame.
 		*/
 	private:
+		// general face 3D model points
+		inline static const std::array<cv::Point3d, 6> MODEL_POINTS = {
+			cv::Point3d(0.0, 0.0, 0.0),       // Nose tip
+			cv::Point3d(0, -63.6, -12.5),     // Chin
+			cv::Point3d(-43.3, 32.7, -26),    // Left eye, left corner
+			cv::Point3d(43.3, 32.7, -26),     // Right eye, right corner
+			cv::Point3d(-28.9, -28.9, -24.1), // Left Mouth corner
+			cv::Point3d(28.9, -28.9, -24.1)   // Right mouth corner
+		};
+		// MODEL_POINTS without the right (left) eye and mouth corners
+		inline static const std::array<cv::Point3d, 4> MODEL_POINTS_LEFT = {
+			cv::Point3d(0.0, 0.0, 0.0), cv::Point3d(0, -63.6, -12.5),
+			cv::Point3d(-43.3, 32.7, -26), cv::Point3d(-28.9, -28.9, -24.1)
+		};
+		inline static const std::array<cv::Point3d, 4> MODEL_POINTS_RIGHT = {
+			cv::Point3d(0.0, 0.0, 0.0), cv::Point3d(0, -63.6, -12.5),
+			cv::Point3d(43.3, 32.7, -26), cv::Point3d(28.9, -28.9, -24.1)
+		};
+
+		inline static const cv::Vec3d EYE_BALL_CENTER_RIGHT = cv::Vec3d(29.05, 32.7, -39.5);
+		inline static const cv::Vec3d EYE_BALL_CENTER_LEFT = cv::Vec3d(-29.05, 32.7, -39.5);
+		static constexpr double EYE_BALL_RADIUS = 12.0;
+
+		GazeMode mode;
+
+		// Camera matrix estimation, cached per frame size
+		size_t cached_frame_width = 0;
+		size_t cached_frame_height = 0;
+		cv::Matx33d camera_matrix;
+		cv::Matx33d camera_matrix_inv;
+
+		// Head pose of the previous frame. Consecutive frames barely move,
+		// so it seeds a short refinement instead of solving from scratch.
+		static constexpr int WARM_START_MAX_ITERATIONS = 5;
+		bool has_head_pose = false;
+		cv::Vec3d rotation_vector;
+		cv::Vec3d translation_vector;
+		WarmStartGate warm_start_gate;
+
+		// estimateAffine3D may release its output on failure, which a
+		// fixed-size Matx cannot do. The Mat is reused in place instead
+		// (3x4, CV_64F once estimated).
+		cv::Mat transformation;
+
 		cv::Point2d relative(const cv::Point3d point, const size_t frame_width, const size_t frame_height) {
 			return cv::Point2d(static_cast<int>(point.x * frame_width), static_cast<int>(point.y * frame_height));
 		}
@@ -24,14 +85,118 @@ namespace dms {
 			return cv::Point3d(static_cast<int>(point.x * frame_width), static_cast<int>(point.y * frame_height), 0);
 		}
 
+		void updateCameraMatrix(const size_t frame_width, const size_t frame_height) {
+			if (frame_width == this->cached_frame_width && frame_height == this->cached_frame_height)
+				return;
+
+			double focal_length = frame_width;
+			cv::Point2d center(frame_width / 2, frame_height / 2);
+			this->camera_matrix = cv::Matx33d(focal_length, 0, center.x,
+			                                  0, focal_length, center.y,
+			                                  0, 0, 1);
+			this->camera_matrix_inv = this->camera_matrix.inv();
+			this->cached_frame_width = frame_width;
+			this->cached_frame_height = frame_height;
+			this->has_head_pose = false;
+		}
+
+		static cv::Matx33d rotationMatrix(const cv::Vec3d& rvec) {
+			return cv::Matx33d(rodrigues({ rvec[0], rvec[1], rvec[2] }).data());
+		}
+
+		// Mean distance [px] between the image points and the model points
+		// projected with the given pose
+		double reprojectionError(const std::array<cv::Point2d, 6>& image_points, const cv::Vec3d& rvec, const cv::Vec3d& tvec) const {
+			const cv::Matx33d rotation_matrix = rotationMatrix(rvec);
+
+			double error = 0;
+			for (size_t i = 0; i < MODEL_POINTS.size(); ++i) {
+				cv::Vec3d projected = this->camera_matrix * (rotation_matrix * cv::Vec3d(MODEL_POINTS[i]) + tvec);
+				error += cv::norm(cv::Point2d(projected[0] / projected[2], projected[1] / projected[2]) - image_points[i]);
+			}
+			return error / MODEL_POINTS.size();
+		}
+
+		// Solve PnP problem, assuming no lens distortion. Starts from the
+		// previous pose with a capped number of LM iterations, and falls
+		// back to a full solve if the reprojection error jumps past what
+		// the last full solve reached.
+		void solveHeadPose(const std::array<cv::Point2d, 6>& image_points) {
+			if (this->has_head_pose) {
+				std::array<Vec3, 6> model;
+				std::array<Vec2, 6> image;
+				for (size_t i = 0; i < MODEL_POINTS.size(); ++i) {
+					model[i] = { MODEL_POINTS[i].x, MODEL_POINTS[i].y, MODEL_POINTS[i].z };
+					image[i] = { image_points[i].x, image_points[i].y };
+				}
+				Vec3 rvec = { this->rotation_vector[0], this->rotation_vector[1], this->rotation_vector[2] };
+				Vec3 tvec = { this->translation_vector[0], this->translation_vector[1], this->translation_vector[2] };
+				double error = refinePose(model, image, this->camera_matrix(0, 0), this->camera_matrix(0, 2), this->camera_matrix(1, 2),
+				                          rvec, tvec, WARM_START_MAX_ITERATIONS, FLT_EPSILON);
+
+				if (this->warm_start_gate.accepts(error)) {
+					this->rotation_vector = cv::Vec3d(rvec[0], rvec[1], rvec[2]);
+					this->translation_vector = cv::Vec3d(tvec[0], tvec[1], tvec[2]);
+					return;
+				}
+			}
+
+			cv::solvePnP(MODEL_POINTS, image_points, this->camera_matrix, cv::noArray(), this->rotation_vector, this->translation_vector);
+			this->warm_start_gate.coldSolved(this->reprojectionError(image_points, this->rotation_vector, this->translation_vector));
+			this->has_head_pose = true;
+		}
+
+		// The Mat keeps the previous frame's transformation when estimation
+		// fails, so success is taken from the return value.
+		template <size_t N>
+		bool estimateTransformation(const std::array<cv::Point3d, N>& image_points, const std::array<cv::Point3d, N>& model_points) {
+			return cv::estimateAffine3D(image_points, model_points, this->transformation, cv::noArray()) != 0 &&
+			       !this->transformation.empty();
+		}
+
+		// Project pupil image point into 3D world point
+		cv::Vec3d toWorld(const cv::Point2d& pupil) const {
+			return cv::Matx34d(this->transformation.ptr<double>()) * cv::Vec4d(pupil.x, pupil.y, 0, 1);
+		}
+
+		// Intersect the camera ray through a pupil image point with the
+		// eyeball sphere, in model space. If the ray misses the eyeball,
+		// the point of the sphere closest to the ray is used.
+		cv::Vec3d pupilOnEyeBall(const cv::Point2d& pupil, const cv::Vec3d& eye_ball_center, const cv::Matx33d& rotation_matrix) const {
+			const cv::Matx33d rotation_matrix_t = rotation_matrix.t();
+			const cv::Vec3d origin = -(rotation_matrix_t * this->translation_vector);
+			const cv::Vec3d direction = cv::normalize(rotation_matrix_t * (this->camera_matrix_inv * cv::Vec3d(pupil.x, pupil.y, 1)));
+
+			const double closest = (eye_ball_center - origin).dot(direction);
+			const cv::Vec3d offset = origin + direction * closest - eye_ball_center;
+			const double offset_sq = offset.dot(offset);
+			const double radius_sq = EYE_BALL_RADIUS * EYE_BALL_RADIUS;
+			if (offset_sq <= radius_sq)
+				return origin + direction * (closest - std::sqrt(radius_sq - offset_sq));
+			return eye_ball_center + offset * (EYE_BALL_RADIUS / std::sqrt(offset_sq));
+		}
+
+		// 3D gaze point
+		static cv::Vec3d gazePoint(const cv::Vec3d& eye_ball_center, const cv::Vec3d& pupil_world_cord) {
+			return eye_ball_center + (pupil_world_cord - eye_ball_center) * 10;
+		}
+
 	public:
+		GazeEstimator(const GazeMode mode = GazeMode::AFFINE) : mode(mode) {}
+
+		/*
+		Forget the previous head pose, e.g. when the face was lost or
+		the driver changed. The next frame is solved from scratch.
+		*/
+		void reset() { this->has_head_pose = false; }
+
 		/*
 		This method must be called for every single frame. More details
 		about the gaze estimating algorithm is provided in README.md
 		*/
 		GazeAngle estimateGaze(const DMSLandmarks& dmsl, const size_t frame_width, const size_t frame_height)  {
 			// 2D image points
-			std::vector<cv::Point2d> image_points = {
+			const std::array<cv::Point2d, 6> image_points = {
 				relative(dmsl.landmarks[0], frame_width, frame_height),  // Nose tip
 				relative(dmsl.landmarks[1], frame_width, frame_height),  // Chin
 				relative(dmsl.landmarks[7], frame_width, frame_height),  // Left eye left corner
@@ -40,48 +205,24 @@ namespace dms {
 				relative(dmsl.landmarks[3], frame_width, frame_height)   // Right mouth corner
 			};
 
-			// general face 3D model points
-			std::vector<cv::Point3d> model_points = {
-				cv::Point3d(0.0, 0.0, 0.0),       // Nose tip
-				cv::Point3d(0, -63.6, -12.5),     // Chin
-				cv::Point3d(-43.3, 32.7, -26),    // Left eye, left corner
-				cv::Point3d(43.3, 32.7, -26),     // Right eye, right corner
-				cv::Point3d(-28.9, -28.9, -24.1), // Left Mouth corner
-				cv::Point3d(28.9, -28.9, -24.1)   // Right mouth corner
-			};
-
-			cv::Point3d Eye_ball_center_right = cv::Point3d(29.05, 32.7, -39.5);
-			cv::Point3d Eye_ball_center_left = cv::Point3d(-29.05, 32.7, -39.5);
-
-			// Camera matrix estimation
-			double focal_length = frame_width;
-			cv::Point2d center(frame_width / 2, frame_height / 2);
-			cv::Mat camera_matrix = (cv::Mat_<double>(3, 3) << focal_length, 0, center.x,
-									0, focal_length, center.y,
-									0, 0, 1);
-
-			cv::Mat dist_coeffs = cv::Mat::zeros(4, 1, cv::DataType<double>::type); // Assuming no lens distortion
-
-			// Solve PnP problem
-			cv::Mat rotation_vector, translation_vector;
-			cv::solvePnP(model_points, image_points, camera_matrix, dist_coeffs, rotation_vector, translation_vector);
+			this->updateCameraMatrix(frame_width, frame_height);
+			this->solveHeadPose(image_points);
 
 			// Calculate Head rotation vector
-			cv::Mat rotation_matrix;
-			cv::Rodrigues(rotation_vector, rotation_matrix);
+			const cv::Matx33d rotation_matrix = rotationMatrix(this->rotation_vector);
 
-			double sy = sqrt(rotation_matrix.at<double>(0, 0) * rotation_matrix.at<double>(0, 0) +
-							rotation_matrix.at<double>(1, 0) * rotation_matrix.at<double>(1, 0));
+			double sy = sqrt(rotation_matrix(0, 0) * rotation_matrix(0, 0) +
+							rotation_matrix(1, 0) * rotation_matrix(1, 0));
 
 			double x = 0, y = 0, z = 0;
 			if (sy < 1e-6) {
-				x = atan2(rotation_matrix.at<double>(2, 1), rotation_matrix.at<double>(2, 2));
-				y = atan2(-rotation_matrix.at<double>(2, 0), sy);
-				z = atan2(rotation_matrix.at<double>(1, 0), rotation_matrix.at<double>(0, 0));
+				x = atan2(rotation_matrix(2, 1), rotation_matrix(2, 2));
+				y = atan2(-rotation_matrix(2, 0), sy);
+				z = atan2(rotation_matrix(1, 0), rotation_matrix(0, 0));
 			}
 			else {
-				x = atan2(-rotation_matrix.at<double>(1, 2), rotation_matrix.at<double>(1, 1));
-				y = atan2(-rotation_matrix.at<double>(2, 0), sy);
+				x = atan2(-rotation_matrix(1, 2), rotation_matrix(1, 1));
+				y = atan2(-rotation_matrix(2, 0), sy);
 				z = 0;
 			}
 
@@ -89,14 +230,28 @@ namespace dms {
 			double head_yaw = y * 180 / PI;
 			double head_roll = z * 180 / PI;
 
+			if (this->mode == GazeMode::ANALYTIC) {
+				// Each pupil must land on the eyeball of its own side: the
+				// LEFT_EYE_* landmarks are fitted to the model's -x side.
+				cv::Point2d pupil_model_left = relative(dmsl.landmarks[LEFT_PUPIL_CENTER], frame_width, frame_height);
+				cv::Point2d pupil_model_right = relative(dmsl.landmarks[RIGHT_PUPIL_CENTER], frame_width, frame_height);
+
+				// Same direction as the affine path below, where (S - pupil)
+				// is proportional to (pupil - eyeball center), over both eyes
+				cv::Vec3d gaze_vector = (this->pupilOnEyeBall(pupil_model_left, EYE_BALL_CENTER_LEFT, rotation_matrix) - EYE_BALL_CENTER_LEFT) +
+				                        (this->pupilOnEyeBall(pupil_model_right, EYE_BALL_CENTER_RIGHT, rotation_matrix) - EYE_BALL_CENTER_RIGHT);
+				double gaze_yaw = atan2(gaze_vector[0], gaze_vector[2]) * 180 / PI;
+				double gaze_pitch = atan2(gaze_vector[1], gaze_vector[2]) * 180 / PI;
+
+				return {gaze_yaw, gaze_pitch};
+			}
+
 			// Pupil locations
 			cv::Point2d left_pupil = relative(dmsl.landmarks[17], frame_width, frame_height);
 			cv::Point2d right_pupil = relative(dmsl.landmarks[16], frame_width, frame_height);
 
 			// Transformation between image point to world point
-			cv::Mat transformation;
-
-			std::vector<cv::Point3d> image_points1 = {
+			const std::array<cv::Point3d, 6> image_points1 = {
 				relativeT(dmsl.landmarks[0], frame_width, frame_height),  // Nose tip
 				relativeT(dmsl.landmarks[1], frame_width, frame_height),  // Chin
 				relativeT(dmsl.landmarks[7], frame_width, frame_height),  // Left eye left corner
@@ -105,42 +260,35 @@ namespace dms {
 				relativeT(dmsl.landmarks[3], frame_width, frame_height)   // Right mouth corner
 			};
 
-			cv::estimateAffine3D(image_points1, model_points, transformation, cv::noArray());
-
-			cv::Mat pupil_world_cord;
-			cv::Mat S;
-
-			if (!transformation.empty()) {
-				// Project pupil image point into 3D world point
-				cv::Mat pupil_world_cord_left = transformation * (cv::Mat_<double>(4, 1) << left_pupil.x, left_pupil.y, 0, 1);
-				cv::Mat pupil_world_cord_right = transformation * (cv::Mat_<double>(4, 1) << right_pupil.x, right_pupil.y, 0, 1);
+			cv::Vec3d pupil_world_cord;
+			cv::Vec3d S;
 
-				// 3D gaze point
-				cv::Mat S_left = (cv::Mat(Eye_ball_center_left) + (pupil_world_cord_left - cv::Mat(Eye_ball_center_left)) * 10);
-				cv::Mat S_right = (cv::Mat(Eye_ball_center_right) + (pupil_world_cord_right - cv::Mat(Eye_ball_center_right)) * 10);
+			if (this->estimateTransformation(image_points1, MODEL_POINTS)) {
+				cv::Vec3d pupil_world_cord_left = this->toWorld(left_pupil);
+				cv::Vec3d pupil_world_cord_right = this->toWorld(right_pupil);
 
 				pupil_world_cord = (pupil_world_cord_left + pupil_world_cord_right) * 0.5;
-				S = (S_left + S_right) * 0.5;
+				S = (gazePoint(EYE_BALL_CENTER_LEFT, pupil_world_cord_left) + gazePoint(EYE_BALL_CENTER_RIGHT, pupil_world_cord_right)) * 0.5;
 			}
 			else {
 				if (head_yaw > 0) {
-					std::vector<cv::Point3d> image_points_left = {image_points1[0], image_points1[1], image_points1[2], image_points1[4]};
-					std::vector<cv::Point3d> model_points_left = {model_points[0], model_points[1], model_points[2], model_points[4]};
-					cv::estimateAffine3D(image_points_left, model_points_left, transformation, cv::noArray());
-					pupil_world_cord = transformation * (cv::Mat_<double>(4, 1) << left_pupil.x, left_pupil.y, 0, 1);
-					S = (cv::Mat(Eye_ball_center_left) + (pupil_world_cord - cv::Mat(Eye_ball_center_left)) * 10);
+					const std::array<cv::Point3d, 4> image_points_left = {image_points1[0], image_points1[1], image_points1[2], image_points1[4]};
+					if (!this->estimateTransformation(image_points_left, MODEL_POINTS_LEFT))
+						return {0, 0};
+					pupil_world_cord = this->toWorld(left_pupil);
+					S = gazePoint(EYE_BALL_CENTER_LEFT, pupil_world_cord);
 				}
 				else {
-					std::vector<cv::Point3d> image_points_right = {image_points1[0], image_points1[1], image_points1[3], image_points1[5]};
-					std::vector<cv::Point3d> model_points_right = {model_points[0], model_points[1], model_points[3], model_points[5]};
-					cv::estimateAffine3D(image_points_right, model_points_right, transformation, cv::noArray());
-					pupil_world_cord = transformation * (cv::Mat_<double>(4, 1) << right_pupil.x, right_pupil.y, 0, 1);
-					S = (cv::Mat(Eye_ball_center_right) + (pupil_world_cord - cv::Mat(Eye_ball_center_right)) * 10);
+					const std::array<cv::Point3d, 4> image_points_right = {image_points1[0], image_points1[1], image_points1[3], image_points1[5]};
+					if (!this->estimateTransformation(image_points_right, MODEL_POINTS_RIGHT))
+						return {0, 0};
+					pupil_world_cord = this->toWorld(right_pupil);
+					S = gazePoint(EYE_BALL_CENTER_RIGHT, pupil_world_cord);
 				}
 			}
-			cv::Mat gaze_vector = S - pupil_world_cord;
-			double gaze_yaw = atan2(gaze_vector.at<double>(0, 0), gaze_vector.at<double>(2, 0)) * 180 / PI;
-			double gaze_pitch = atan2(gaze_vector.at<double>(1, 0), gaze_vector.at<double>(2, 0)) * 180 / PI;
+			cv::Vec3d gaze_vector = S - pupil_world_cord;
+			double gaze_yaw = atan2(gaze_vector[0], gaze_vector[2]) * 180 / PI;
+			double gaze_pitch = atan2(gaze_vector[1], gaze_vector[2]) * 180 / PI;
 
 			return {gaze_yaw, gaze_pitch};
 		}
@@ -1,7 +1,18 @@
 #ifndef FACE_RECOGNIZER_HPP
 #define FACE_RECOGNIZER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <dlib/clustering.h>
@@ -12,129 +23,347 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "asset_bundle.hpp"
 #include "common.hpp"
+#include "driver_database.hpp"
+#include "face_embedder.h"
+#include "identity_verifier.hpp"
+#include "run_graph_main.h"
 
 namespace dms {
-	class DriverRegistrar {
+	class FaceModels {
 		/*
-		Register driver by saving the driver's facial embedding vector.
+		The face detector, shape predictor and recognizer, loaded once per
+		process and shared by registration and authentication. The dlib
+		networks keep per-call state, so inference holds `mutex`.
 		*/
 	private:
-		const std::string SHAPE_PREDICTOR_PATH = "shape_predictor_5_face_landmarks.dat";
-		const std::string FACE_RECOGNIZER_PATH = "dlib_face_recognition_resnet_model_v1.dat";
+		static inline const std::string SHAPE_PREDICTOR_PATH = "shape_predictor_5_face_landmarks.dat";
+		static inline const std::string FACE_RECOGNIZER_PATH = "dlib_face_recognition_resnet_model_v1.dat";
+
+		FaceModels() : detector(dlib::get_frontal_face_detector()),
+		               predictor(),
+		               face_recognizer(),
+		               worker_detectors(std::max(1u, std::thread::hardware_concurrency()), detector) {
+			load(SHAPE_PREDICTOR_PATH, predictor);
+			load(FACE_RECOGNIZER_PATH, face_recognizer);
+			if (!quantizedRecognizerPath().empty()) {
+				std::unique_ptr<FaceEmbedderWrapper> embedder(new FaceEmbedderWrapper());
+				if (embedder->initFaceEmbedder(quantizedRecognizerPath()))
+					quantized_recognizer = std::move(embedder);
+				else
+					std::cerr << "Error: Unable to load " << quantizedRecognizerPath() << ", using the float recognizer." << std::endl;
+			}
+		}
+
+		// From the asset bundle if it has the model, else from the file next to the executable.
+		template <typename Model>
+		static void load(const std::string& name, Model& model) {
+			const std::shared_ptr<const AssetBundle> assets = AssetBundle::shared();
+			const std::string_view asset = assets ? assets->find(name) : std::string_view();
+			if (asset.empty()) {
+				dlib::deserialize(installPath(name)) >> model;
+				return;
+			}
+			AssetStream in(asset);
+			dlib::deserialize(model, in);
+		}
+
+		static std::string& quantizedRecognizerPath() {
+			static std::string path;
+			return path;
+		}
+
+		static std::shared_future<std::shared_ptr<FaceModels>>& loader() {
+			static std::shared_future<std::shared_ptr<FaceModels>> models =
+				std::async(std::launch::async, [] {
+					return std::shared_ptr<FaceModels>(new FaceModels());
+				}).share();
+			return models;
+		}
+
+	public:
 		dlib::frontal_face_detector detector;
 		dlib::shape_predictor predictor;
 		dms::anet_type face_recognizer;
+		// The same network exported to TFLite and run in fp16 or int8 on
+		// XNNPACK. Null unless useQuantizedRecognizer() was called.
+		std::unique_ptr<FaceEmbedderWrapper> quantized_recognizer;
+		// One detector per registration worker; the HOG scanner is not
+		// reentrant. The shape predictor is, so the workers share it.
+		std::vector<dlib::frontal_face_detector> worker_detectors;
+		std::mutex mutex;
 
-	public:
-		DriverRegistrar() : detector(dlib::get_frontal_face_detector()),
-		                    predictor(),
-		                    face_recognizer() {
-			dlib::deserialize(SHAPE_PREDICTOR_PATH) >> predictor;
-			dlib::deserialize(FACE_RECOGNIZER_PATH) >> face_recognizer;
+		FaceModels(const FaceModels&) = delete;
+		FaceModels& operator=(const FaceModels&) = delete;
+
+		/*
+		Makes embed() use the TFLite model at `model_path` instead of the
+		dlib network. Must be called before preload() or get(). The two
+		give close but not identical descriptors, so drivers should be
+		registered with the recognizer they are authenticated with.
+		*/
+		static void useQuantizedRecognizer(const std::string& model_path) {
+			quantizedRecognizerPath() = model_path;
+		}
+
+		// Descriptor of a 150x150 face chip from the recognizer in use. Hold `mutex`.
+		dlib::matrix<float, 0, 1> embed(dlib::matrix<dlib::rgb_pixel>& face_chip) {
+			if (!quantized_recognizer) return face_recognizer(face_chip);
+			dlib::matrix<float, 0, 1> descriptor;
+			descriptor.set_size(face_descriptor_size);
+			if (!quantized_recognizer->computeDescriptor(dlib::toMat(face_chip), descriptor.begin()))
+				descriptor = face_recognizer(face_chip);
+			return descriptor;
+		}
+
+		std::vector<dlib::matrix<float, 0, 1>> embed(std::vector<dlib::matrix<dlib::rgb_pixel>>& face_chips) {
+			if (!quantized_recognizer) return face_recognizer(face_chips);
+			std::vector<dlib::matrix<float, 0, 1>> descriptors;
+			for (auto& face_chip : face_chips)
+				descriptors.push_back(embed(face_chip));
+			return descriptors;
 		}
 
+		/*
+		Starts loading the models in the background. Call it early so that
+		the first registration or authentication doesn't pay for it.
+		*/
+		static void preload() {
+			loader();
+		}
+
+		/*
+		Returns the shared models, waiting for the load to finish. Rethrows
+		whatever the load threw.
+		*/
+		static FaceModels& get() {
+			return *loader().get();
+		}
+	};
+
+	class DriverRegistrar {
+		/*
+		Register driver by saving the driver's facial embedding vector.
+		*/
+	private:
+		FaceModels& models;
+
+	public:
+		DriverRegistrar() : models(FaceModels::get()) {}
+
 		/*
 		Takes a facial images in a form of cv::Mat, passes them through
 		a DNN network, and save their embedding vectors on a disk.
+		An empty `driver_name` is replaced by the number the database
+		gives the driver (see DriverDatabase::append).
+		On failure `err` is ENODATA if too few faces were found, EIO if
+		face detection or embedding threw or the driver could not be
+		saved, and EEXIST or ENAMETOOLONG if the name was not accepted.
 		*/
 		bool registerDriver(std::vector<cv::Mat>& main_cam_images,
 			const std::vector<cv::Point2d>& driver_gaze_angle,
-			const std::string& driver_name,
+			std::string& driver_name,
 			int& err)  {
 			DriverInfo driver_info;
-			std::vector<dlib::matrix<dlib::rgb_pixel>> faces;
-			std::vector<dlib::matrix<float, 0, 1>> face_descriptors;
 			driver_info.name = driver_name;
+			err = 0;
 
-			for (auto cam_image : main_cam_images) {
-				// main_cam_images를 matrix<rgb_pixel>로 변환
-				dlib::matrix<dlib::rgb_pixel> rgb_image;
-				dlib::assign_image(rgb_image, dlib::cv_image<dlib::bgr_pixel>(cam_image)); // rgb_pixel로 변경
-				//***********************
-				// 가장 큰 얼굴 찾아서 넣기
-				//***********************
-				for (auto face : this->detector(rgb_image)) {
-					auto shape = this->predictor(rgb_image, face);
-					dlib::matrix<dlib::rgb_pixel> face_chip;
-					// 이미지에서 얼굴 탐지기를 실행하고 각 얼굴에 대해 150x150 픽셀 크기로 정규화되고 적절하게 회전되고 중앙에 맞도록 복사본을 추출합니다.
-					dlib::extract_image_chip(rgb_image, dlib::get_face_chip_details(shape, 150, 0.25), face_chip);
-					// 이미지에서 얼굴 찾고 faces에 푸시
-					faces.push_back(std::move(face_chip));
+			// 얼굴 탐지/정렬은 이미지별로 worker 스레드에서 병렬로 하고,
+			// 끝난 이미지부터 순서대로 바로 128vector로 전환
+			const size_t num_images = main_cam_images.size();
+			std::vector<std::vector<dlib::matrix<dlib::rgb_pixel>>> image_faces(num_images);
+			std::vector<char> image_done(num_images, 0);
+			std::mutex done_m;
+			std::condition_variable done_cv;
+			std::atomic<size_t> next_image{ 0 };
+			// The first exception of any thread. Once set, workers stop
+			// taking images and the embedding loop stops waiting for them.
+			std::atomic<bool> failed{ false };
+			std::exception_ptr failure;
+			const auto fail = [&] {
+				{
+					std::lock_guard<std::mutex> lock(done_m);
+					if (!failure) failure = std::current_exception();
+					failed = true;
+				}
+				done_cv.notify_all();
+			};
+
+			std::unique_lock<std::mutex> models_lock(models.mutex);
+			const size_t num_workers = std::min(models.worker_detectors.size(), num_images);
+			std::vector<std::thread> workers;
+			// Joins the workers however this function is left.
+			struct Joiner {
+				std::vector<std::thread>& threads;
+				void join() {
+					for (auto& thread : threads)
+						if (thread.joinable()) thread.join();
+				}
+				~Joiner() { join(); }
+			} joiner{ workers };
+			for (size_t w = 0; w < num_workers; w++) {
+				workers.emplace_back([&, w] {
+					try {
+						dlib::frontal_face_detector& detector = models.worker_detectors[w];
+						for (size_t i; !failed && (i = next_image++) < num_images;) {
+							// main_cam_images를 matrix<rgb_pixel>로 변환
+							dlib::matrix<dlib::rgb_pixel> rgb_image;
+							dlib::assign_image(rgb_image, dlib::cv_image<dlib::bgr_pixel>(main_cam_images[i])); // rgb_pixel로 변경
+							//***********************
+							// 가장 큰 얼굴 찾아서 넣기
+							//***********************
+							for (auto face : detector(rgb_image)) {
+								auto shape = models.predictor(rgb_image, face);
+								dlib::matrix<dlib::rgb_pixel> face_chip;
+								// 이미지에서 얼굴 탐지기를 실행하고 각 얼굴에 대해 150x150 픽셀 크기로 정규화되고 적절하게 회전되고 중앙에 맞도록 복사본을 추출합니다.
+								dlib::extract_image_chip(rgb_image, dlib::get_face_chip_details(shape, 150, 0.25), face_chip);
+								// 이미지에서 얼굴 찾고 faces에 푸시
+								image_faces[i].push_back(std::move(face_chip));
+							}
+							{
+								std::lock_guard<std::mutex> lock(done_m);
+								image_done[i] = 1;
+							}
+							done_cv.notify_one();
+						}
+					}
+					catch (...) {
+						fail();
+					}
+				});
+			}
+			size_t num_faces = 0;
+			try {
+				for (size_t i = 0; i < num_images; i++) {
+					{
+						std::unique_lock<std::mutex> lock(done_m);
+						done_cv.wait(lock, [&] { return image_done[i] != 0 || failed; });
+					}
+					if (failed) break;
+					if (image_faces[i].empty()) continue;
+					// 128vector 로 전환
+					for (auto& emb_vec : models.embed(image_faces[i]))
+						driver_info.emb_vecs.push_back(std::move(emb_vec));
+					num_faces += image_faces[i].size();
+				}
+			}
+			catch (...) {
+				fail();
+			}
+			joiner.join();
+			if (failure) {
+				try {
+					std::rethrow_exception(failure);
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Error: Unable to register the driver: " << e.what() << std::endl;
 				}
+				catch (...) {
+					std::cerr << "Error: Unable to register the driver." << std::endl;
+				}
+				err = EIO;
+				return false;
 			}
 			// faces size()가 3 이하 return false
-			if (faces.size() <= 3) return false;
-			// 128vector 로 전환
-			driver_info.emb_vecs = face_recognizer(faces);
-
-			DriverInfo driver_trash;
-			
-			std::string str1 = "../drivers/";
-			std::string str2 = ".bin";
-			std::string path = str1 + "1" + str2;
-			// int err;
-			int err_save;
-			/////////////////////////////////수정부분
-
-			std::ofstream ofs(path, std::ios::binary);
-			if (!ofs) {
-				std::cerr << "Error: Unable to open file for writing." << std::endl;
-				//error parsing
+			if (num_faces <= 3) {
+				err = ENODATA;
 				return false;
 			}
+			models_lock.unlock();
 
-			size_t num_embedding_vectors = driver_info.emb_vecs.size();
-			ofs.write(reinterpret_cast<const char*>(&num_embedding_vectors), sizeof(num_embedding_vectors));
-
-			for (const auto& descriptor : driver_info.emb_vecs) {
-				size_t num_rows = descriptor.nr();
-				size_t num_cols = descriptor.nc();
-
-				ofs.write(reinterpret_cast<const char*>(&num_rows), sizeof(num_rows));
-				ofs.write(reinterpret_cast<const char*>(&num_cols), sizeof(num_cols));
-				ofs.write(reinterpret_cast<const char*>(descriptor.begin()), num_rows * num_cols * sizeof(float));
+			// 운전자 DB 끝에 추가 (기존 운전자는 그대로 유지)
+			DriverDatabase& database = DriverDatabase::shared();
+			const int id = database.append(driver_info.name, driver_info.emb_vecs);
+			if (id < 0) {
+				std::cerr << "Error: Unable to save the driver." << std::endl;
+				err = -id;
+				return false;
 			}
-
-			ofs.close();
+			driver_name = database.snapshot()->driver(id).name;
 			return true;
 		}
 	};
 
 	class DriverAuthenticator {
 	private:
-		const std::string SHAPE_PREDICTOR_PATH = "shape_predictor_5_face_landmarks.dat";
-		const std::string FACE_RECOGNIZER_PATH = "dlib_face_recognition_resnet_model_v1.dat";
-		dlib::frontal_face_detector detector;
-		dlib::shape_predictor predictor;
-		dms::anet_type face_recognizer;
+		FaceModels& models;
 
 	public:
-		DriverAuthenticator() : detector(dlib::get_frontal_face_detector()),
-		                        predictor(),
-		                        face_recognizer() {
-			dlib::deserialize(SHAPE_PREDICTOR_PATH) >> predictor;
-			dlib::deserialize(FACE_RECOGNIZER_PATH) >> face_recognizer;
+		/*
+		Builds dlib's 5 point shape (left eye outer/inner corner, right eye
+		outer/inner corner, bottom of the nose) from MediaPipe landmarks.
+		Returns false if any of the points falls outside the frame.
+		*/
+		static bool alignmentShape(const DMSLandmarks& landmarks, const int width, const int height,
+			dlib::full_object_detection& shape) {
+			const LandmarkNames points[5] = {
+				LEFT_EYE_LEFT_CORNER, LEFT_EYE_RIGHT_CORNER,
+				RIGHT_EYE_RIGHT_CORNER, RIGHT_EYE_LEFT_CORNER,
+				NOSE_BOTTOM
+			};
+			std::vector<dlib::point> parts;
+			dlib::rectangle bounds;
+			for (const LandmarkNames point : points) {
+				const cv::Point3d& landmark = landmarks.landmarks[point];
+				if (landmark.x < 0 || landmark.x >= 1 || landmark.y < 0 || landmark.y >= 1)
+					return false;
+				parts.emplace_back(static_cast<long>(landmark.x * width), static_cast<long>(landmark.y * height));
+				bounds += parts.back();
+			}
+			shape = dlib::full_object_detection(bounds, parts);
+			return true;
+		}
+
+	private:
+		/*
+		Compares `driver_descriptor` with all of the registered embedding
+		vectors. Find out the most relevant--meaning nearest in terms of
+		Euclidean distance--driver, and verify if the distance is lower
+		than the predefined threshold.
+		*/
+		bool matchDriver(const dlib::matrix<float, 0, 1>& driver_descriptor, std::string& driver_name) {
+            // 등록된 운전자 벡터 (시작할 때 mmap 해둔 DB)
+            std::shared_ptr<const EmbeddingStore> drivers = DriverDatabase::shared().snapshot();
+            if (!drivers) {
+                std::cout << "등록된 사람이 없습니다." << std::endl;
+                return false;
+            }
+            // 등록된 벡터와 비교 (운전자별 평균 거리가 가장 작은 사람)
+            const std::vector<DescriptorMatcher::Match> matches =
+                drivers->matcher().match(driver_descriptor.begin(), 0, DescriptorMatcher::Aggregation::MEAN);
+            if (matches.empty()) {
+                std::cout << "등록된 사람이 없습니다." << std::endl;
+                return false;
+            }
+            if (matches[0].distance < 0.45) {
+                driver_name = drivers->driver(matches[0].driver).name;
+                return true; // 인증 성공
+            }
+            // 인증된 사람이 아닙니다
+            std::cout << "인증된 사람 아닙니다." << std::endl;
+
+            return false;
 		}
 
+	public:
+		DriverAuthenticator() : models(FaceModels::get()) {}
+
 		/*
-		Takes a single image and compare its embedding vector with all
-		of the embedding vectors saved on the disk. Find out the most
-		relevant--meaning nearest in terms of Euclidean distance--embedding
-		vector, and verify if the distance is lower than the predefined
-		threshold.
+		Takes a single image, finds the face with the HOG detector and
+		compares its embedding vector with the registered drivers.
 		*/
 		bool authenticateDriver(cv::Mat& main_cam_image, std::string& driver_name, int& err) {
-            DriverInfo driver_info[4];
             std::vector<dlib::matrix<dlib::rgb_pixel>> faces;
+            std::unique_lock<std::mutex> models_lock(models.mutex);
             // 이미지 matrix<RGB_pixel>로 변환
             dlib::matrix<dlib::rgb_pixel> driver_img;
             dlib::assign_image(driver_img, dlib::cv_image<dlib::bgr_pixel>(main_cam_image)); // rgb_pixel로 변경
             // ****************************************
             // 제일 큰 이미지 하나만 faces에 푸시해야함 <- 이거 없음
             // ****************************************
-            for (auto face : this->detector(driver_img)) {
-                auto shape = this->predictor(driver_img, face);
+            for (auto face : models.detector(driver_img)) {
+                auto shape = models.predictor(driver_img, face);
                 dlib::matrix<dlib::rgb_pixel> face_chip;
                 dlib::extract_image_chip(driver_img, dlib::get_face_chip_details(shape, 150, 0.25), face_chip);
                 faces.push_back(std::move(face_chip));
@@ -146,75 +375,351 @@ namespace dms {
                 return false;
             }
             // 128 vector 변환
-            dlib::matrix<float, 0, 1> driver_descriptor = this->face_recognizer(faces[0]);
-            // 디스크 저장된 등록된 운전자 벡터 받아오기
-
-            bool dat_load[4];
-            ////
-            for (int i = 0; i < 4; i++) {
-                std::string str1 = "../drivers/";
-                std::string str2 = ".bin";
-                std::string path = str1 + std::to_string(i + 1) + str2;
-                // int err;
-                
-                std::ifstream ifs(path, std::ios::binary);
-                if (!ifs) {
-                    std::cerr << "Error: Unable to open file for reading." << std::endl;
-                    dat_load[i] = false;
-                }
-                else {
-                    size_t num_embedding_vectors;
-                    ifs.read(reinterpret_cast<char*>(&num_embedding_vectors), sizeof(num_embedding_vectors));
-
-                    driver_info[i].emb_vecs.resize(num_embedding_vectors);
-
-                    for (auto& descriptor : driver_info[i].emb_vecs) {
-                        size_t num_rows, num_cols;
-                        ifs.read(reinterpret_cast<char*>(&num_rows), sizeof(num_rows));
-                        ifs.read(reinterpret_cast<char*>(&num_cols), sizeof(num_cols));
-
-                        descriptor.set_size(num_rows, num_cols);
-                        ifs.read(reinterpret_cast<char*>(descriptor.begin()), num_rows * num_cols * sizeof(float));
-                    }
-
-                    ifs.close();
-                    dat_load[i] = true;
-                }
-            }
-            // 등록된 벡터와 비교
-            float vector_lengths[4];
-            int min_idx = 0;
-            float sum_length = 0.0f;
-            for (int i = 0; i < 4; i++) {
-                if (!dat_load[i]) {
-                    vector_lengths[i] = 1;
-                    continue; // 만약 정보가 없는 idx면 패스
-                }
-                sum_length = 0;
-                for (int j = 0; j < driver_info[i].emb_vecs.size(); ++j) {
-                    float leng = length(driver_info[i].emb_vecs[j] - driver_descriptor);
-                    std::cout << leng << '\n';
-                    sum_length += leng;
-                }
-                vector_lengths[i] = sum_length / driver_info[i].emb_vecs.size();
-                if (vector_lengths[i] < vector_lengths[min_idx]) {
-                    min_idx = i;
-                }
-            }
-            if (vector_lengths[min_idx] < 0.45) {
-                driver_name = driver_info[min_idx].name;
-                return true; // 인증 성공
-            }
-            if (vector_lengths[min_idx] == 1) {
-                // 등록된사람 없습니다
-                std::cout << "등록된 사람이 없습니다." << std::endl;
-                return false;
-            }
-            // 인증된 사람이 아닙니다
-            std::cout << "인증된 사람 아닙니다." << std::endl;
-
-            return false;
+            dlib::matrix<float, 0, 1> driver_descriptor = models.embed(faces[0]);
+            models_lock.unlock();
+            return matchDriver(driver_descriptor, driver_name);
         }
+
+		/*
+		Finds the face to authenticate in dlib's 5 point layout: from the
+		landmark graph if it saw one, otherwise with the HOG detector and
+		the shape predictor. Returns false unless exactly one face is found.
+		*/
+		bool locateFace(cv::Mat& main_cam_image, const DMSLandmarks& landmarks, const bool landmark_presence,
+			dlib::full_object_detection& shape) {
+			if (landmark_presence && alignmentShape(landmarks, main_cam_image.cols, main_cam_image.rows, shape))
+				return true;
+
+			dlib::matrix<dlib::rgb_pixel> driver_img;
+			dlib::assign_image(driver_img, dlib::cv_image<dlib::bgr_pixel>(main_cam_image));
+			std::lock_guard<std::mutex> models_lock(models.mutex);
+			const std::vector<dlib::rectangle> faces = models.detector(driver_img);
+			if (faces.size() != 1) return false;
+			shape = models.predictor(driver_img, faces[0]);
+			return true;
+		}
+
+		// Cuts the 150x150 chip the ResNet expects straight from the BGR frame.
+		static void faceChip(cv::Mat& main_cam_image, const dlib::full_object_detection& shape,
+			dlib::matrix<dlib::rgb_pixel>& face_chip) {
+			dlib::extract_image_chip(dlib::cv_image<dlib::bgr_pixel>(main_cam_image),
+				dlib::get_face_chip_details(shape, 150, 0.25), face_chip);
+		}
+
+		dlib::matrix<float, 0, 1> embedFace(dlib::matrix<dlib::rgb_pixel>& face_chip) {
+			std::lock_guard<std::mutex> models_lock(models.mutex);
+			return models.embed(face_chip);
+		}
+
+		/*
+		Same as above, but the face is located by the landmark graph that
+		ran on the same image, so the full-frame HOG scan and the shape
+		predictor are skipped. Falls back to them if there is no face or
+		the face is partly outside the frame.
+		*/
+		bool authenticateDriver(cv::Mat& main_cam_image, const DMSLandmarks& landmarks, const bool landmark_presence,
+			std::string& driver_name, int& err) {
+			dlib::full_object_detection shape;
+			if (!landmark_presence || !alignmentShape(landmarks, main_cam_image.cols, main_cam_image.rows, shape))
+				return authenticateDriver(main_cam_image, driver_name, err);
+
+			// 전체 이미지 변환 없이 얼굴 부분만 150x150으로 잘라냄
+			dlib::matrix<dlib::rgb_pixel> face_chip;
+			faceChip(main_cam_image, shape, face_chip);
+			return matchDriver(embedFace(face_chip), driver_name);
+		}
+	};
+
+	class StreamingAuthenticator {
+		/*
+		Authenticate a driver from a stream of camera frames instead of a
+		single shot. Frames whose face is too small, turned away or blurry
+		are dropped before the ResNet. The rest add to a running mean
+		distance per registered driver. The driver is accepted once they
+		have been the nearest driver within the threshold for MIN_FRAMES
+		frames in a row and their running mean is within it as well, so a
+		single lucky frame no longer unlocks. After MAX_FRAMES embedded
+		frames without that, the driver is rejected.
+		*/
+	public:
+		enum class Decision {
+			PENDING,
+			ACCEPTED,
+			REJECTED
+		};
+
+	private:
+		static constexpr float THRESHOLD = 0.45f;
+		static constexpr size_t MIN_FRAMES = 3;
+		static constexpr size_t MAX_FRAMES = 10;
+		static constexpr double MIN_EYE_DISTANCE = 50.0; // px between the outer eye corners
+		static constexpr double MAX_YAW_OFFSET = 0.2;    // Nose off the middle of the eyes, relative to their distance
+		static constexpr double MIN_SHARPNESS = 30.0;    // Variance of the Laplacian of the gray chip
+
+		DriverAuthenticator authenticator;
+		std::shared_ptr<const EmbeddingStore> drivers;
+		std::vector<float> distance_sums;
+		size_t num_frames;
+		size_t candidate;
+		size_t streak;
+		Decision decision;
+
+	public:
+		// Whether a face is large and frontal enough to be worth embedding
+		static bool frontalEnough(const dlib::full_object_detection& shape) {
+			const dlib::dpoint left_eye = shape.part(0);
+			const dlib::dpoint right_eye = shape.part(2);
+			const dlib::dpoint nose = shape.part(4);
+			const dlib::dpoint eye_line = left_eye - right_eye;
+			const double eye_distance = eye_line.length();
+			if (eye_distance < MIN_EYE_DISTANCE) return false;
+			const double nose_position = (nose - right_eye).dot(eye_line) / (eye_distance * eye_distance);
+			return std::abs(nose_position - 0.5) <= MAX_YAW_OFFSET;
+		}
+
+		// Whether a face chip is not too blurry to be worth embedding
+		static bool sharpEnough(dlib::matrix<dlib::rgb_pixel>& face_chip) {
+			cv::Mat gray, laplacian;
+			cv::cvtColor(dlib::toMat(face_chip), gray, cv::COLOR_RGB2GRAY);
+			cv::Laplacian(gray, laplacian, CV_64F);
+			cv::Scalar mean, stddev;
+			cv::meanStdDev(laplacian, mean, stddev);
+			return stddev[0] * stddev[0] >= MIN_SHARPNESS;
+		}
+
+		StreamingAuthenticator() : authenticator() {
+			reset();
+		}
+
+		// Starts over with the drivers registered by now.
+		void reset() {
+			drivers = DriverDatabase::shared().snapshot();
+			distance_sums.assign(drivers ? drivers->numDrivers() : 0, 0.f);
+			num_frames = 0;
+			candidate = 0;
+			streak = 0;
+			decision = Decision::PENDING;
+			if (distance_sums.empty()) {
+				std::cout << "등록된 사람이 없습니다." << std::endl;
+				decision = Decision::REJECTED;
+			}
+		}
+
+		/*
+		Takes the next camera frame and, if the landmark graph ran on it,
+		its landmarks. Returns the decision so far.
+		*/
+		Decision addFrame(cv::Mat& main_cam_image, const DMSLandmarks& landmarks, const bool landmark_presence) {
+			if (decision != Decision::PENDING) return decision;
+
+			dlib::full_object_detection shape;
+			if (!authenticator.locateFace(main_cam_image, landmarks, landmark_presence, shape)) return decision;
+			if (!frontalEnough(shape)) return decision;
+			dlib::matrix<dlib::rgb_pixel> face_chip;
+			DriverAuthenticator::faceChip(main_cam_image, shape, face_chip);
+			if (!sharpEnough(face_chip)) return decision;
+
+			const dlib::matrix<float, 0, 1> driver_descriptor = authenticator.embedFace(face_chip);
+			const std::vector<DescriptorMatcher::Match> matches =
+				drivers->matcher().match(driver_descriptor.begin(), 0, DescriptorMatcher::Aggregation::MEAN);
+			for (const DescriptorMatcher::Match& match : matches)
+				distance_sums[match.driver] += match.distance;
+			num_frames++;
+
+			const DescriptorMatcher::Match& nearest = matches[0];
+			if (nearest.distance >= THRESHOLD)
+				streak = 0;
+			else if (streak > 0 && nearest.driver == candidate)
+				streak++;
+			else {
+				candidate = nearest.driver;
+				streak = 1;
+			}
+
+			if (streak >= MIN_FRAMES && distance_sums[candidate] / num_frames < THRESHOLD)
+				decision = Decision::ACCEPTED;
+			else if (num_frames >= MAX_FRAMES)
+				decision = Decision::REJECTED;
+			return decision;
+		}
+
+		// Without a landmark graph; every frame goes through the HOG detector.
+		Decision addFrame(cv::Mat& main_cam_image) {
+			return addFrame(main_cam_image, DMSLandmarks(), false);
+		}
+
+		// Frames that passed the quality checks and were embedded
+		size_t frames() const { return num_frames; }
+
+		// Name of the accepted driver
+		std::string driverName() const {
+			return decision == Decision::ACCEPTED ? drivers->driver(candidate).name : "";
+		}
+	};
+
+	class DriverIdentityTracker {
+		/*
+		Keeps checking who is driving during monitoring without running the
+		recognizer on every frame. The face box is tracked through the
+		landmark stream, and as long as it moves on smoothly from frame to
+		frame it is taken to be the same person. The ResNet only runs again
+		once the track is lost (the face was gone for a while or jumped) or
+		REVERIFY_INTERVAL has passed. The new embedding is compared with the
+		cached one first; the registered drivers are only searched if that
+		no longer matches, e.g. after a driver swap at a stop.
+
+		`update` only tracks and cuts the face chip, so it is cheap enough
+		for the monitoring loop. Embedding and matching run on a verifier
+		thread of the tracker's own; their results come back through a
+		TripleBuffer and are picked up by a later `update`.
+		*/
+	public:
+		using Status = IdentityStatus; // After CHANGED, see driverName()
+
+	private:
+		static constexpr double MIN_OVERLAP = 0.3;     // IoU of the face boxes of consecutive results
+		static constexpr size_t MAX_MISSED_FRAMES = 15; // Results without a face before the track is lost
+		static constexpr std::chrono::microseconds REVERIFY_INTERVAL = std::chrono::minutes(1);
+
+		// A face chip to verify, cut from a frame of track `track`
+		struct VerificationRequest {
+			size_t seq;
+			size_t track;
+			dlib::matrix<dlib::rgb_pixel> face_chip;
+		};
+
+		// Outcome of the request numbered `seq`
+		struct Verification {
+			size_t seq = 0;
+			size_t track = 0;
+			Status status = Status::PENDING;
+			std::string driver_name;
+		};
+
+		// Monitoring thread side
+		std::string driver_name;
+		dlib::rectangle face_box;
+		size_t missed_frames;
+		size_t verified_at_us;
+		bool verification_due;
+		size_t track;         // Bumped whenever the track is lost
+		size_t requested_seq; // Last request handed to the verifier
+		size_t collected_seq; // Last verification picked up
+		Status status;
+
+		Channel<VerificationRequest, 2> requests;
+		TripleBuffer<Verification> verifications;
+		std::thread verifier;
+
+		static double overlap(const dlib::rectangle& a, const dlib::rectangle& b) {
+			const double intersection = a.intersect(b).area();
+			const double union_area = a.area() + b.area() - intersection;
+			return union_area > 0 ? intersection / union_area : 0;
+		}
+
+		// Whoever comes back into view is unknown until they are embedded.
+		void loseTrack() {
+			status = Status::PENDING;
+			verification_due = true;
+			track++;
+		}
+
+		// Takes the newest verification, unless it belongs to a lost track.
+		void collect() {
+			const Verification& verification = verifications.read();
+			if (verification.seq == collected_seq) return;
+			collected_seq = verification.seq;
+			if (verification.track != track) return;
+			status = verification.status;
+			driver_name = verification.driver_name;
+		}
+
+		/*
+		Verifier thread. Owns the recognizer and the IdentityVerifier that
+		follows the driver by their record index.
+		*/
+		static void verify(Channel<VerificationRequest, 2>& requests, TripleBuffer<Verification>& verifications,
+			std::string driver_name) {
+			DriverAuthenticator authenticator;
+			std::shared_ptr<const EmbeddingStore> drivers = DriverDatabase::shared().snapshot();
+			IdentityVerifier verifier(drivers && !driver_name.empty() ? drivers->findDriver(driver_name) : -1);
+			VerificationRequest request;
+			while (requests.pop(request)) {
+				Verification& verification = verifications.writeBuffer();
+				verification.seq = request.seq;
+				verification.track = request.track;
+				const dlib::matrix<float, 0, 1> descriptor = authenticator.embedFace(request.face_chip);
+				drivers = DriverDatabase::shared().snapshot();
+				verification.status = verifier.verify(descriptor, drivers.get());
+				// Records are only ever appended, so an index stays valid.
+				if (drivers && verifier.driverId() >= 0)
+					driver_name = drivers->driver(verifier.driverId()).name;
+				verification.driver_name = driver_name;
+				verifications.publish();
+			}
+		}
+
+	public:
+		// `driver_name` is the authenticated driver, empty if nobody was.
+		// Names are unique, so it is resolved to the driver's record once.
+		explicit DriverIdentityTracker(const std::string& driver_name = "")
+			: driver_name(driver_name), missed_frames(MAX_MISSED_FRAMES + 1), verified_at_us(0),
+			  verification_due(true), track(0), requested_seq(0), collected_seq(0), status(Status::PENDING),
+			  verifier(verify, std::ref(requests), std::ref(verifications), driver_name) {}
+
+		DriverIdentityTracker(const DriverIdentityTracker&) = delete;
+		DriverIdentityTracker& operator=(const DriverIdentityTracker&) = delete;
+
+		// Waits for a verification still running, if any.
+		~DriverIdentityTracker() {
+			requests.close();
+			verifier.join();
+		}
+
+		/*
+		Takes the landmark graph's result for `main_cam_image`, taken at
+		`timestamp_us`. Returns the identity status so far. Never waits
+		for the recognizer.
+		*/
+		Status update(cv::Mat& main_cam_image, const DMSLandmarks& landmarks, const bool landmark_presence,
+			const size_t timestamp_us) {
+			collect();
+
+			dlib::full_object_detection shape;
+			if (!landmark_presence ||
+				!DriverAuthenticator::alignmentShape(landmarks, main_cam_image.cols, main_cam_image.rows, shape)) {
+				if (++missed_frames == MAX_MISSED_FRAMES + 1)
+					loseTrack();
+				return status;
+			}
+
+			const dlib::rectangle box = shape.get_rect();
+			if (missed_frames <= MAX_MISSED_FRAMES && overlap(box, face_box) < MIN_OVERLAP)
+				loseTrack();
+			face_box = box;
+			missed_frames = 0;
+			if (timestamp_us - verified_at_us >= static_cast<size_t>(REVERIFY_INTERVAL.count()))
+				verification_due = true;
+			// One verification at a time; the next good frame goes once it is back.
+			if (!verification_due || requested_seq != collected_seq)
+				return status;
+
+			if (!StreamingAuthenticator::frontalEnough(shape)) return status;
+			VerificationRequest request;
+			DriverAuthenticator::faceChip(main_cam_image, shape, request.face_chip);
+			if (!StreamingAuthenticator::sharpEnough(request.face_chip)) return status;
+
+			request.seq = requested_seq + 1;
+			request.track = track;
+			if (!requests.push(request)) return status;
+			requested_seq = request.seq;
+			verified_at_us = timestamp_us;
+			verification_due = false;
+			return status;
+		}
+
+		// The driver as of the last verification
+		const std::string& driverName() const { return driver_name; }
 	};
 }
 
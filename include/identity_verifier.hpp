@@ -0,0 +1,61 @@
+#ifndef IDENTITY_VERIFIER_HPP
+#define IDENTITY_VERIFIER_HPP
+
+#include <vector>
+
+#include <dlib/matrix.h>
+
+#include "descriptor_matcher.hpp"
+#include "driver_database.hpp"
+
+namespace dms {
+	enum class IdentityStatus {
+		PENDING,  // Not verified yet, or the track was lost and no good frame came since
+		VERIFIED, // The driver is who they were
+		CHANGED,  // Someone else registered took over
+		UNKNOWN   // Someone unregistered took over
+	};
+
+	class IdentityVerifier {
+		/*
+		Decides whether a face embedded during monitoring is still the
+		driver. The driver is known by the index of their DriverRecord,
+		not by name. A descriptor close to the one last verified is the
+		same driver; anything else is looked up among the registered
+		drivers, and the nearest one within THRESHOLD becomes the driver.
+		*/
+	public:
+		static constexpr float THRESHOLD = 0.45f;
+
+	private:
+		int driver_id;
+		dlib::matrix<float, 0, 1> driver_descriptor; // Empty until the first lookup
+
+	public:
+		// `driver_id` indexes the authenticated driver's record, -1 if nobody was.
+		explicit IdentityVerifier(const int driver_id = -1) : driver_id(driver_id) {}
+
+		// `drivers` may be null if nobody is registered.
+		IdentityStatus verify(const dlib::matrix<float, 0, 1>& descriptor, const EmbeddingStore* drivers) {
+			if (driver_descriptor.size() != 0 && dlib::length(descriptor - driver_descriptor) < THRESHOLD)
+				return IdentityStatus::VERIFIED;
+			if (!drivers) return IdentityStatus::UNKNOWN;
+
+			const std::vector<DescriptorMatcher::Match> matches =
+				drivers->matcher().match(descriptor.begin(), 0, DescriptorMatcher::Aggregation::MEAN);
+			if (matches.empty() || matches[0].distance >= THRESHOLD)
+				return IdentityStatus::UNKNOWN;
+
+			const int nearest = static_cast<int>(matches[0].driver);
+			const IdentityStatus status = nearest == driver_id ? IdentityStatus::VERIFIED : IdentityStatus::CHANGED;
+			driver_id = nearest;
+			driver_descriptor = descriptor;
+			return status;
+		}
+
+		// The driver as of the last verification, -1 if there was none
+		int driverId() const { return driver_id; }
+	};
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef POSE_REFINER_HPP
+#define POSE_REFINER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+namespace dms {
+	using Vec2 = std::array<double, 2>;
+	using Vec3 = std::array<double, 3>;
+	using Mat3 = std::array<double, 9>; // Row-major
+
+	/*
+	Rotation matrix of the Rodrigues rotation vector `r`, as cv::Rodrigues
+	computes it.
+	*/
+	inline Mat3 rodrigues(const Vec3& r) {
+		const double theta = std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+		if (theta < 1e-12)
+			return { 1, -r[2], r[1], r[2], 1, -r[0], -r[1], r[0], 1 };
+
+		const double kx = r[0] / theta, ky = r[1] / theta, kz = r[2] / theta;
+		const double c = std::cos(theta), s = std::sin(theta), c1 = 1 - c;
+		return {
+			c + c1 * kx * kx,      c1 * kx * ky - s * kz, c1 * kx * kz + s * ky,
+			c1 * ky * kx + s * kz, c + c1 * ky * ky,      c1 * ky * kz - s * kx,
+			c1 * kz * kx - s * ky, c1 * kz * ky + s * kx, c + c1 * kz * kz
+		};
+	}
+
+	/*
+	Pinhole projection of `point` with the pose (`R`, `t`) and a camera of
+	focal length `focal` [px] centered at (`cx`, `cy`), without distortion.
+	*/
+	inline Vec2 project(const Vec3& point, const Mat3& R, const Vec3& t, const double focal, const double cx, const double cy) {
+		const double x = R[0] * point[0] + R[1] * point[1] + R[2] * point[2] + t[0];
+		const double y = R[3] * point[0] + R[4] * point[1] + R[5] * point[2] + t[1];
+		const double z = R[6] * point[0] + R[7] * point[1] + R[8] * point[2] + t[2];
+		return { focal * x / z + cx, focal * y / z + cy };
+	}
+
+	/*
+	Refines the pose (`rvec`, `tvec`) that maps `model` onto `image` with
+	at most `max_iterations` Levenberg-Marquardt steps, stopping early once
+	a step is shorter than `epsilon`. Does the job of cv::solvePnPRefineLM
+	for a handful of points, on the stack only, so a warm-started head
+	pose costs no heap allocation. Returns the mean reprojection error
+	[px] of the refined pose.
+	*/
+	template <size_t N>
+	double refinePose(const std::array<Vec3, N>& model, const std::array<Vec2, N>& image,
+		const double focal, const double cx, const double cy,
+		Vec3& rvec, Vec3& tvec, const int max_iterations, const double epsilon) {
+		constexpr size_t P = 6; // rvec, tvec
+
+		const auto residuals = [&](const std::array<double, P>& x, std::array<double, 2 * N>& e) {
+			const Mat3 R = rodrigues({ x[0], x[1], x[2] });
+			const Vec3 t = { x[3], x[4], x[5] };
+			double cost = 0;
+			for (size_t i = 0; i < N; i++) {
+				const Vec2 p = project(model[i], R, t, focal, cx, cy);
+				e[2 * i] = p[0] - image[i][0];
+				e[2 * i + 1] = p[1] - image[i][1];
+				cost += e[2 * i] * e[2 * i] + e[2 * i + 1] * e[2 * i + 1];
+			}
+			return cost;
+		};
+
+		std::array<double, P> x = { rvec[0], rvec[1], rvec[2], tvec[0], tvec[1], tvec[2] };
+		std::array<double, 2 * N> e;
+		double cost = residuals(x, e);
+		double lambda = 1e-3;
+
+		for (int iteration = 0; iteration < max_iterations; iteration++) {
+			// Jacobian by central differences; 12 residuals make that cheap.
+			std::array<std::array<double, P>, 2 * N> J;
+			for (size_t j = 0; j < P; j++) {
+				const double h = 1e-6 * std::max(1.0, std::fabs(x[j]));
+				std::array<double, P> xp = x, xm = x;
+				xp[j] += h;
+				xm[j] -= h;
+				std::array<double, 2 * N> ep, em;
+				residuals(xp, ep);
+				residuals(xm, em);
+				for (size_t i = 0; i < 2 * N; i++)
+					J[i][j] = (ep[i] - em[i]) / (2 * h);
+			}
+
+			std::array<std::array<double, P>, P> JtJ{};
+			std::array<double, P> Jte{};
+			for (size_t i = 0; i < 2 * N; i++) {
+				for (size_t j = 0; j < P; j++) {
+					Jte[j] += J[i][j] * e[i];
+					for (size_t k = 0; k < P; k++)
+						JtJ[j][k] += J[i][j] * J[i][k];
+				}
+			}
+
+			// Raise lambda until a step lowers the cost.
+			bool improved = false;
+			std::array<double, P> step{};
+			while (!improved && lambda < 1e10) {
+				// Solve (JtJ + lambda * diag(JtJ)) step = -Jte by Gaussian elimination.
+				std::array<std::array<double, P + 1>, P> A;
+				for (size_t j = 0; j < P; j++) {
+					for (size_t k = 0; k < P; k++)
+						A[j][k] = JtJ[j][k];
+					A[j][j] += lambda * JtJ[j][j] + 1e-12;
+					A[j][P] = -Jte[j];
+				}
+				bool singular = false;
+				for (size_t c = 0; c < P && !singular; c++) {
+					size_t pivot = c;
+					for (size_t r = c + 1; r < P; r++)
+						if (std::fabs(A[r][c]) > std::fabs(A[pivot][c])) pivot = r;
+					if (std::fabs(A[pivot][c]) < 1e-300) singular = true;
+					std::swap(A[c], A[pivot]);
+					for (size_t r = c + 1; r < P && !singular; r++) {
+						const double f = A[r][c] / A[c][c];
+						for (size_t k = c; k <= P; k++)
+							A[r][k] -= f * A[c][k];
+					}
+				}
+				if (singular) {
+					lambda *= 10;
+					continue;
+				}
+				for (size_t c = P; c-- > 0;) {
+					double v = A[c][P];
+					for (size_t k = c + 1; k < P; k++)
+						v -= A[c][k] * step[k];
+					step[c] = v / A[c][c];
+				}
+
+				std::array<double, P> candidate;
+				for (size_t j = 0; j < P; j++)
+					candidate[j] = x[j] + step[j];
+				std::array<double, 2 * N> candidate_e;
+				const double candidate_cost = residuals(candidate, candidate_e);
+				if (candidate_cost < cost) {
+					x = candidate;
+					e = candidate_e;
+					cost = candidate_cost;
+					lambda = std::max(lambda / 10, 1e-12);
+					improved = true;
+				}
+				else {
+					lambda *= 10;
+				}
+			}
+			if (!improved) break;
+
+			double step_norm = 0;
+			for (size_t j = 0; j < P; j++)
+				step_norm += step[j] * step[j];
+			if (std::sqrt(step_norm) < epsilon) break;
+		}
+
+		rvec = { x[0], x[1], x[2] };
+		tvec = { x[3], x[4], x[5] };
+		double error = 0;
+		for (size_t i = 0; i < N; i++)
+			error += std::hypot(e[2 * i], e[2 * i + 1]);
+		return error / N;
+	}
+
+	/*
+	Decides whether a warm-started pose is kept or the pose is solved
+	again from scratch. The bound is taken from the last cold solve, not
+	from the previous warm frame, so a warm start that drifts a little
+	further every frame cannot keep raising it.
+	*/
+	class WarmStartGate {
+	public:
+		static constexpr double ERROR_JUMP = 2.0;  // Allowed error growth over the last cold solve
+		static constexpr double ERROR_FLOOR = 2.0; // [px] Errors below this are always accepted
+
+		void coldSolved(const double error) { this->cold_error = error; }
+
+		bool accepts(const double warm_error) const {
+			return warm_error <= std::max(ERROR_FLOOR, this->cold_error * ERROR_JUMP);
+		}
+
+	private:
+		double cold_error = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef STAGE_TIMER_HPP
+#define STAGE_TIMER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace dms {
+	// Stages of the monitoring pipeline timed in production
+	enum class Stage {
+		CAPTURE,   // VideoCapture::read on the camera thread
+		SUBMIT,    // Color conversion into the graph's input frame and upload
+		GRAPH,     // Frame submitted to its result polled
+		LANDMARKS, // Landmark copy handed to the inferrer
+		GAZE,
+		EAR,
+		DISPLAY,   // Overlay, captions and imshow
+		GAZE_ALT,  // The other gaze mode, replay with --gaze-compare only
+		TOTAL,     // Whole frame, capture to EAR, replay only
+		COUNT
+	};
+
+	inline const char* stageName(const Stage stage) {
+		static const char* const names[] = { "capture", "submit", "graph", "landmarks", "gaze", "ear", "display", "gaze-alt", "total" };
+		return names[static_cast<size_t>(stage)];
+	}
+
+	class LatencyHistogram {
+	/*
+	HDR-style histogram of latencies in microseconds: exact below
+	SUB_BUCKETS, then SUB_BUCKETS / 2 buckets per power of two, so every
+	value is kept within ~3% up to MAX_US. Memory and recording cost are
+	fixed no matter how many samples are added, unlike LatencyStats.
+
+	Only one thread may `add`. The counts are atomics written with plain
+	relaxed stores, so any other thread can read them at any time without
+	locking or slowing down the writer.
+	*/
+	public:
+		static constexpr int SUB_BUCKET_BITS = 6;
+		static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BUCKET_BITS;
+		static constexpr uint64_t MAX_US = uint64_t(1) << 26; // ~67 s, larger values are clamped
+		static constexpr size_t BUCKETS = (26 - SUB_BUCKET_BITS) * (SUB_BUCKETS / 2) + SUB_BUCKETS;
+
+	private:
+		std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+		std::atomic<uint64_t> max_us{0};
+
+		static int msb(const uint64_t v) {
+			return 63 - __builtin_clzll(v);
+		}
+
+	public:
+		static size_t bucketOf(uint64_t us) {
+			if (us >= MAX_US) us = MAX_US - 1;
+			if (us < SUB_BUCKETS) return static_cast<size_t>(us);
+			const int shift = msb(us) - (SUB_BUCKET_BITS - 1);
+			return static_cast<size_t>(shift) * (SUB_BUCKETS / 2) + (us >> shift);
+		}
+
+		// Midpoint of the values that fall into `bucket`
+		static double valueOf(const size_t bucket) {
+			if (bucket < SUB_BUCKETS) return static_cast<double>(bucket);
+			const uint64_t shift = (bucket - SUB_BUCKETS / 2) / (SUB_BUCKETS / 2);
+			const uint64_t sub = bucket - shift * (SUB_BUCKETS / 2);
+			return ((sub << shift) + ((sub + 1) << shift) - 1) / 2.;
+		}
+
+		void add(const uint64_t us) {
+			std::atomic<uint64_t>& count = this->counts[bucketOf(us)];
+			count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			if (us > this->max_us.load(std::memory_order_relaxed))
+				this->max_us.store(us, std::memory_order_relaxed);
+		}
+
+		// Adds the counts of `other` to this one, e.g. to merge threads.
+		void merge(const LatencyHistogram& other) {
+			for (size_t i = 0; i < BUCKETS; i++) {
+				std::atomic<uint64_t>& count = this->counts[i];
+				count.store(count.load(std::memory_order_relaxed) + other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			if (other.maxUs() > this->maxUs())
+				this->max_us.store(other.maxUs(), std::memory_order_relaxed);
+		}
+
+		uint64_t count() const {
+			uint64_t total = 0;
+			for (const std::atomic<uint64_t>& count : this->counts)
+				total += count.load(std::memory_order_relaxed);
+			return total;
+		}
+
+		uint64_t maxUs() const {
+			return this->max_us.load(std::memory_order_relaxed);
+		}
+
+		/*
+		`p` is in [0, 100]. Returns 0 if no sample was added.
+		*/
+		double percentileUs(const double p) const {
+			const uint64_t total = this->count();
+			if (total == 0) return 0;
+			if (p >= 100) return static_cast<double>(this->maxUs());
+
+			const uint64_t rank = static_cast<uint64_t>(p / 100 * (total - 1)) + 1;
+			uint64_t seen = 0;
+			for (size_t i = 0; i < BUCKETS; i++) {
+				seen += this->counts[i].load(std::memory_order_relaxed);
+				if (seen >= rank)
+					return std::min(valueOf(i), static_cast<double>(this->maxUs()));
+			}
+			return static_cast<double>(this->maxUs());
+		}
+	};
+
+	class StageTimers {
+	/*
+	Per-thread latency histograms of every Stage. A thread gets its own
+	set the first time it records, which is the only time a lock is
+	taken; after that recording touches nothing another thread writes.
+	Readers merge the sets of all threads, including threads that have
+	exited, whenever percentiles are asked for.
+	*/
+	private:
+		using Histograms = std::array<LatencyHistogram, static_cast<size_t>(Stage::COUNT)>;
+
+		struct Registry {
+			std::mutex m;
+			std::vector<std::unique_ptr<Histograms>> threads;
+		};
+
+		static Registry& registry() {
+			// Never destroyed, so threads still recording during exit are safe.
+			static Registry* r = new Registry();
+			return *r;
+		}
+
+		static Histograms& local() {
+			thread_local Histograms* histograms = [] {
+				Registry& r = registry();
+				std::lock_guard<std::mutex> lg(r.m);
+				r.threads.push_back(std::make_unique<Histograms>());
+				return r.threads.back().get();
+			}();
+			return *histograms;
+		}
+
+		static std::atomic<bool>& reportRequested() {
+			static std::atomic<bool> requested{false};
+			return requested;
+		}
+
+	public:
+		static void record(const Stage stage, const std::chrono::steady_clock::duration latency) {
+			const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+			local()[static_cast<size_t>(stage)].add(us > 0 ? static_cast<uint64_t>(us) : 0);
+		}
+
+		// Histogram of `stage` over every thread that recorded it
+		static std::unique_ptr<LatencyHistogram> merged(const Stage stage) {
+			auto histogram = std::make_unique<LatencyHistogram>();
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lg(r.m);
+			for (const std::unique_ptr<Histograms>& histograms : r.threads)
+				histogram->merge((*histograms)[static_cast<size_t>(stage)]);
+			return histogram;
+		}
+
+		/*
+		Prints count, p50, p90, p99 and max of every stage recorded so
+		far, in milliseconds. Leaves the formatting of `os` as it was.
+		*/
+		static void report(std::ostream& os) {
+			const std::ios_base::fmtflags flags = os.flags();
+			const std::streamsize precision = os.precision();
+			os << "stage        count       p50       p90       p99       max" << std::endl;
+			for (size_t i = 0; i < static_cast<size_t>(Stage::COUNT); i++) {
+				const Stage stage = static_cast<Stage>(i);
+				const std::unique_ptr<LatencyHistogram> histogram = merged(stage);
+				if (histogram->count() == 0) continue;
+				os << std::left << std::setw(10) << stageName(stage) << std::right
+				   << std::setw(8) << histogram->count()
+				   << std::fixed << std::setprecision(2)
+				   << std::setw(10) << histogram->percentileUs(50) / 1000
+				   << std::setw(10) << histogram->percentileUs(90) / 1000
+				   << std::setw(10) << histogram->percentileUs(99) / 1000
+				   << std::setw(10) << histogram->percentileUs(100) / 1000 << std::endl;
+			}
+			os.flags(flags);
+			os.precision(precision);
+		}
+
+		/*
+		Asks for a report at the next `reportIfRequested`. Only sets a
+		lock-free flag, so it may be called from a signal handler.
+		*/
+		static void requestReport() {
+			reportRequested().store(true, std::memory_order_relaxed);
+		}
+
+		static void reportIfRequested(std::ostream& os) {
+			if (reportRequested().load(std::memory_order_relaxed) && reportRequested().exchange(false))
+				report(os);
+		}
+	};
+
+	class ScopedStageTimer {
+	/*
+	Records the time from construction to destruction into the calling
+	thread's histogram of `stage`.
+	*/
+	private:
+		Stage stage;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+		explicit ScopedStageTimer(const Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+		ScopedStageTimer(const ScopedStageTimer&) = delete;
+		ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+		~ScopedStageTimer() {
+			StageTimers::record(this->stage, std::chrono::steady_clock::now() - this->start);
+		}
+	};
+}
+
+#endif
@@ -2,12 +2,20 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QImage>
 #include <QMainWindow>
+#include <QPixmap>
+#include <QString>
+#include <QThread>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
+class FaceWorker;
+class MPPGraphRunnerWrapper;
+namespace dms { class CameraSession; }
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -16,12 +24,41 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Camera shared with the monitoring loop. Must be set before the
+    // window is shown.
+    void setCamera(dms::CameraSession *camera);
+
+    // Landmark graph used to locate the face for authentication. Without
+    // one, authentication scans the whole frame with the HOG detector.
+    // Must be set before the window is shown.
+    void setLandmarkGraph(MPPGraphRunnerWrapper *runner);
+
+    // Name of the driver who unlocked the window, empty if nobody did.
+    QString driverName() const;
+
+signals:
+    void registrationRequested();
+    void authenticationRequested();
+
 private slots:
     void on_registButton_clicked();
 
     void on_authenticButton_clicked();
 
+    void showPreview(const QImage &frame);
+
+    void onRegistrationFinished(bool registered);
+
+    void onAuthenticationFinished(bool authenticated, const QString &driver_name);
+
 private:
     Ui::MainWindow *ui;
+    QPixmap logo;
+    // Camera, registration and authentication run on `worker_thread`
+    QThread worker_thread;
+    FaceWorker *worker;
+    QString authenticated_driver;
+
+    void setBusy(bool busy);
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,158 @@
+// Copyright 2019 The MediaPipe Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+
+#include "mediapipe/framework/calculator_framework.h"
+#include "mediapipe/framework/formats/landmark.pb.h"
+#include "mediapipe/framework/port/ret_check.h"
+#include "mediapipe/framework/port/status.h"
+#include "mediapipe/examples/desktop/run_graph_main.h"
+
+namespace mediapipe {
+
+namespace {
+
+constexpr char kLandmarksTag[] = "LANDMARKS";
+constexpr char kFaceLandmarksTag[] = "FACE_LANDMARKS";
+constexpr char kLeftEyeContourTag[] = "LEFT_EYE_CONTOUR_LANDMARKS";
+constexpr char kRightEyeContourTag[] = "RIGHT_EYE_CONTOUR_LANDMARKS";
+constexpr char kLeftIrisTag[] = "LEFT_EYE_IRIS_LANDMARKS";
+constexpr char kRightIrisTag[] = "RIGHT_EYE_IRIS_LANDMARKS";
+constexpr char kDMSLandmarksTag[] = "DMS_LANDMARKS";
+
+constexpr int kNumFaceLandmarks = 468;
+constexpr int kNumIrisLandmarks = 5;
+
+// Where the eye points the DMS uses sit in the 71 point eye contours of
+// IrisLandmarkLeftAndRight, i.e. the refined values UpdateFaceLandmarksCalculator
+// would have written over them in the face mesh.
+struct RefinedEyeLandmark {
+  int face_index;
+  bool left_eye;
+  int contour_index;
+};
+constexpr RefinedEyeLandmark kRefinedEyeLandmarks[] = {
+    {33, true, 0},    {144, true, 3},   {153, true, 5},
+    {133, true, 8},   {160, true, 11},  {158, true, 13},
+    {263, false, 0},  {373, false, 3},  {380, false, 5},
+    {362, false, 8},  {387, false, 11}, {385, false, 13},
+};
+
+}  // namespace
+
+// Picks the landmarks the DMS uses (see `landmark_converting_table`) out of
+// the face mesh with iris, so the graph hands out a small plain struct
+// instead of the whole 478 point NormalizedLandmarkList.
+//
+// The landmarks come either from the stock iris tracking output, or
+// straight from the face mesh, eye contours and irises, which spares the
+// graph the UpdateFaceLandmarksCalculator and concatenation copies. Eye
+// points are taken from the refined eye contours and the pupil centers
+// from the first landmark of each iris, the same values the stock output
+// would hold.
+//
+// Inputs, either:
+//   LANDMARKS: NormalizedLandmarkList, the face mesh followed by both irises.
+// or all of:
+//   FACE_LANDMARKS: NormalizedLandmarkList, the 468 point face mesh.
+//   LEFT_EYE_CONTOUR_LANDMARKS, RIGHT_EYE_CONTOUR_LANDMARKS:
+//     NormalizedLandmarkList, 71 points each.
+//   LEFT_EYE_IRIS_LANDMARKS, RIGHT_EYE_IRIS_LANDMARKS:
+//     NormalizedLandmarkList, 5 points each.
+//
+// Output:
+//   DMS_LANDMARKS: DMSLandmarks, indexed by LandmarkNames.
+//
+// Example config:
+// node {
+//   calculator: "DMSLandmarksCalculator"
+//   input_stream: "LANDMARKS:face_landmarks_with_iris"
+//   output_stream: "DMS_LANDMARKS:dms_landmarks"
+// }
+class DMSLandmarksCalculator : public CalculatorBase {
+ public:
+  static absl::Status GetContract(CalculatorContract* cc) {
+    if (cc->Inputs().HasTag(kLandmarksTag)) {
+      cc->Inputs().Tag(kLandmarksTag).Set<NormalizedLandmarkList>();
+    } else {
+      for (const char* tag : {kFaceLandmarksTag, kLeftEyeContourTag, kRightEyeContourTag,
+                              kLeftIrisTag, kRightIrisTag}) {
+        RET_CHECK(cc->Inputs().HasTag(tag)) << "Missing " << tag;
+        cc->Inputs().Tag(tag).Set<NormalizedLandmarkList>();
+      }
+    }
+    cc->Outputs().Tag(kDMSLandmarksTag).Set<DMSLandmarks>();
+    return absl::OkStatus();
+  }
+
+  absl::Status Open(CalculatorContext* cc) override {
+    cc->SetOffset(TimestampDiff(0));
+
+    // Resolves every DMS landmark to an input stream and an index in it.
+    for (int i = 0; i < landmark_count; ++i) {
+      const int face_index = landmark_converting_table[i];
+      if (cc->Inputs().HasTag(kLandmarksTag)) {
+        sources_[i] = {kLandmarksTag, face_index};
+      } else if (face_index >= kNumFaceLandmarks + kNumIrisLandmarks) {
+        sources_[i] = {kRightIrisTag, face_index - kNumFaceLandmarks - kNumIrisLandmarks};
+      } else if (face_index >= kNumFaceLandmarks) {
+        sources_[i] = {kLeftIrisTag, face_index - kNumFaceLandmarks};
+      } else {
+        sources_[i] = {kFaceLandmarksTag, face_index};
+        for (const RefinedEyeLandmark& eye_landmark : kRefinedEyeLandmarks) {
+          if (eye_landmark.face_index == face_index) {
+            sources_[i] = {eye_landmark.left_eye ? kLeftEyeContourTag : kRightEyeContourTag,
+                           eye_landmark.contour_index};
+          }
+        }
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status Process(CalculatorContext* cc) override {
+    for (const Source& source : sources_) {
+      if (cc->Inputs().Tag(source.tag).IsEmpty()) {
+        return absl::OkStatus();
+      }
+    }
+
+    auto dms_landmarks = std::make_unique<DMSLandmarks>();
+    for (int i = 0; i < landmark_count; ++i) {
+      const auto& landmarks =
+          cc->Inputs().Tag(sources_[i].tag).Get<NormalizedLandmarkList>();
+      RET_CHECK_LT(sources_[i].index, landmarks.landmark_size());
+      const NormalizedLandmark& landmark = landmarks.landmark(sources_[i].index);
+      dms_landmarks->landmarks[i].x = landmark.x();
+      dms_landmarks->landmarks[i].y = landmark.y();
+      dms_landmarks->landmarks[i].z = landmark.z();
+    }
+
+    cc->Outputs()
+        .Tag(kDMSLandmarksTag)
+        .Add(dms_landmarks.release(), cc->InputTimestamp());
+    return absl::OkStatus();
+  }
+
+ private:
+  struct Source {
+    const char* tag;
+    int index;
+  };
+  Source sources_[landmark_count];
+};
+REGISTER_CALCULATOR(DMSLandmarksCalculator);
+
+}  // namespace mediapipe
@@ -0,0 +1,47 @@
+// Copyright 2019 The MediaPipe Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Runs an exported copy of dlib's face recognition ResNet through TFLite.
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Length of a face descriptor
+constexpr int face_descriptor_size = 128;
+
+struct FaceEmbedderOptions {
+	// Threads of the XNNPACK delegate
+	int num_threads = 2;
+	// Try float models in fp16 first (needs native fp16 arithmetic, e.g.
+	// ARMv8.2 FP16) and fall back to fp32 if the delegate refuses it.
+	// Quantized int8 models always run in int8.
+	bool force_fp16 = true;
+};
+
+class FaceEmbedderWrapper {
+private:
+	void* core_embedder_ptr = nullptr;
+
+public:
+	~FaceEmbedderWrapper();
+	// `model_file` is `dlib_face_recognition_resnet_model_v1` exported to
+	// TFLite: a 1x150x150x3 input with dlib's normalization,
+	// (pixel - channel mean) / 256, and a 128 element output. Float, fp16
+	// and fully int8 quantized models are accepted.
+	bool initFaceEmbedder(std::string model_file, const FaceEmbedderOptions& = FaceEmbedderOptions());
+	// `face_chip` is the 150x150 RGB chip dlib's recognizer takes (CV_8UC3).
+	// Writes `face_descriptor_size` floats to `descriptor`.
+	bool computeDescriptor(const cv::Mat& face_chip, float* descriptor);
+};
@@ -14,9 +14,24 @@
 //
 // An example of sending OpenCV webcam frames into a MediaPipe graph.
 // This example requires a linux computer and a GPU with EGL support drivers.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
 
 #include <opencv2/opencv.hpp>
 
@@ -25,19 +40,21 @@
 #include "absl/log/absl_log.h"
 #include "mediapipe/calculators/util/landmarks_to_render_data_calculator.pb.h"
 #include "mediapipe/framework/calculator_framework.h"
+#include "mediapipe/framework/calculator_profile.pb.h"
 #include "mediapipe/framework/formats/image_frame.h"
 #include "mediapipe/framework/formats/image_frame_opencv.h"
-#include "mediapipe/framework/formats/landmark.pb.h"
 #include "mediapipe/framework/port/file_helpers.h"
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
 #include "mediapipe/framework/port/opencv_imgproc_inc.h"
 #include "mediapipe/framework/port/opencv_video_inc.h"
 #include "mediapipe/framework/port/parse_text_proto.h"
+#include "mediapipe/framework/port/ret_check.h"
 #include "mediapipe/framework/port/status.h"
 #include "mediapipe/gpu/gl_calculator_helper.h"
 #include "mediapipe/gpu/gpu_buffer.h"
 #include "mediapipe/gpu/gpu_shared_data_internal.h"
 #include "mediapipe/util/resource_util.h"
+#include "mediapipe/util/resource_util_custom.h"
 #include "mediapipe/examples/desktop/run_graph_main.h"
 
 #define LOG(msg) { std::cout << __func__ << " " << __LINE__ << " " << msg << std::endl; }
@@ -46,9 +63,17 @@ constexpr char kInputStream[] = "input_video";
 constexpr char kWindowName[] = "MediaPipe";
 
 constexpr char kVideoOutputStream[] = "output_video";
-constexpr char kLandmarksOutputStream[] = "face_landmarks_with_iris";
+constexpr char kLandmarksOutputStream[] = "dms_landmarks";
 constexpr char kLandmarkPresenceOutputStream[] = "landmark_presence";
 
+// Profiler histograms: 100 us intervals up to 50 ms, the last one open ended.
+constexpr int64_t kProfileIntervalUsec = 100;
+constexpr int64_t kProfileIntervals = 500;
+// Trace events buffered between two trace writes, enough for a minute of
+// the full iris tracking graph at 30 fps.
+constexpr int64_t kProfileTraceCapacity = 100000;
+constexpr char kProfileSummaryFile[] = "summary.log";
+
 ABSL_FLAG(std::string, calculator_graph_config_file, "",
           "Name of file containing text format CalculatorGraphConfig proto.");
 ABSL_FLAG(std::string, input_video_path, "",
@@ -58,97 +83,477 @@ ABSL_FLAG(std::string, output_video_path, "",
           "Full path of where to save result (.mp4 only). "
           "If not provided, show result in a window.");
 
-static inline absl::Status createGraphFromFile(
+// Binary CalculatorGraphConfig protos as C string literals, generated from
+// the .pbtxt files by the BUILD file. The DMS-only library
+// (DMS_LANDMARKS_GPU_ONLY) embeds just the graph its calculators can run.
+#ifndef DMS_LANDMARKS_GPU_ONLY
+constexpr char kIrisTrackingGpuGraph[] =
+#include "mediapipe/examples/desktop/iris_tracking_gpu.binarypb.inc"
+;
+constexpr char kIrisTrackingGpuHeadlessGraph[] =
+#include "mediapipe/examples/desktop/iris_tracking_gpu_headless.binarypb.inc"
+;
+constexpr char kIrisTrackingCpuGraph[] =
+#include "mediapipe/examples/desktop/iris_tracking_cpu.binarypb.inc"
+;
+#endif
+constexpr char kDMSLandmarksGpuGraph[] =
+#include "mediapipe/examples/desktop/dms_landmarks_gpu.binarypb.inc"
+;
+
+static inline absl::Status readGraphConfigFile(
   std::string calculator_graph_config_file,
-  mediapipe::CalculatorGraph& graph) {
+  mediapipe::CalculatorGraphConfig& config) {
   std::string calculator_graph_config_contents;
   MP_RETURN_IF_ERROR(mediapipe::file::GetContents(
     calculator_graph_config_file,
     &calculator_graph_config_contents));
   
-  mediapipe::CalculatorGraphConfig config =
-    mediapipe::ParseTextProtoOrDie<mediapipe::CalculatorGraphConfig>(
-      calculator_graph_config_contents);
-  MP_RETURN_IF_ERROR(graph.Initialize(config));
+  config = mediapipe::ParseTextProtoOrDie<mediapipe::CalculatorGraphConfig>(
+    calculator_graph_config_contents);
+
+  return absl::OkStatus();
+}
+
+static inline absl::Status readEmbeddedGraphConfig(
+  MPPGraphConfig graph_config,
+  mediapipe::CalculatorGraphConfig& config) {
+  absl::string_view binary_config;
+  switch (graph_config) {
+#ifdef DMS_LANDMARKS_GPU_ONLY
+    case MPPGraphConfig::IRIS_TRACKING_GPU:
+    case MPPGraphConfig::IRIS_TRACKING_GPU_HEADLESS:
+    case MPPGraphConfig::IRIS_TRACKING_CPU:
+      return absl::UnimplementedError(
+        "librun_graph_main_dms_gpu.so only runs dms_landmarks_gpu.pbtxt (MPPGraphConfig::DMS_LANDMARKS_GPU), "
+        "use librun_graph_main_gpu.so for the iris tracking graphs.");
+#else
+    case MPPGraphConfig::IRIS_TRACKING_GPU:
+      binary_config = absl::string_view(kIrisTrackingGpuGraph, sizeof(kIrisTrackingGpuGraph) - 1);
+      break;
+    case MPPGraphConfig::IRIS_TRACKING_GPU_HEADLESS:
+      binary_config = absl::string_view(kIrisTrackingGpuHeadlessGraph, sizeof(kIrisTrackingGpuHeadlessGraph) - 1);
+      break;
+    case MPPGraphConfig::IRIS_TRACKING_CPU:
+      binary_config = absl::string_view(kIrisTrackingCpuGraph, sizeof(kIrisTrackingCpuGraph) - 1);
+      break;
+#endif
+    case MPPGraphConfig::DMS_LANDMARKS_GPU:
+      binary_config = absl::string_view(kDMSLandmarksGpuGraph, sizeof(kDMSLandmarksGpuGraph) - 1);
+      break;
+  }
+  RET_CHECK(config.ParseFromArray(binary_config.data(), binary_config.size()))
+    << "Corrupt embedded graph config";
+
+  return absl::OkStatus();
+}
+
+// Routes the model files the graph's calculators load through `provider`,
+// falling back to the file system for anything it does not have. With a
+// custom provider set, TfLiteModelLoader hands it the graph's path before
+// looking at the disk, so the provider always wins over loose files.
+static inline void setResourceProvider(
+  const std::function<bool(const std::string&, std::string&)>& provider) {
+  if (!provider)
+    return;
+  mediapipe::SetCustomGlobalResourceProvider(
+    [provider](const std::string& path, std::string* output) -> absl::Status {
+      if (provider(path, *output))
+        return absl::OkStatus();
+      MP_ASSIGN_OR_RETURN(std::string file_path, mediapipe::PathToResourceAsFile(path));
+      return mediapipe::file::GetContents(file_path, output);
+    });
+}
+
+// Turns on the MediaPipe profiler and tracer for `config`. Trace files go to
+// `profile_path`/trace_<n>.binarypb and can be opened in viz.mediapipe.dev.
+static inline absl::Status enableProfiler(
+  const std::string& profile_path,
+  mediapipe::CalculatorGraphConfig& config) {
+  MP_RETURN_IF_ERROR(mediapipe::file::RecursivelyCreateDir(profile_path));
+
+  mediapipe::ProfilerConfig* profiler_config = config.mutable_profiler_config();
+  profiler_config->set_enable_profiler(true);
+  profiler_config->set_enable_stream_latency(true);
+  profiler_config->set_histogram_interval_size_usec(kProfileIntervalUsec);
+  profiler_config->set_num_histogram_intervals(kProfileIntervals);
+  profiler_config->set_trace_enabled(true);
+  profiler_config->set_trace_log_path(profile_path + "/trace_");
+  profiler_config->set_trace_log_capacity(kProfileTraceCapacity);
+  // Writing a trace also resets the histograms, so the runner writes it
+  // itself right after each summary instead of on the profiler's timer.
+  profiler_config->set_trace_log_interval_usec(-1);
+  // Six summaries per file, the last ten files kept.
+  profiler_config->set_trace_log_interval_count(6);
+  profiler_config->set_trace_log_count(10);
 
   return absl::OkStatus();
 }
 
+// Upper edge, in microseconds, of the histogram interval holding the given
+// percentile of `samples` values. The last interval is open ended, so its
+// lower edge is returned instead.
+static inline int64_t histogramPercentile(
+  const mediapipe::TimeHistogram& histogram,
+  int64_t samples,
+  double percentile) {
+  const int64_t rank = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(percentile * samples)));
+  int64_t seen = 0;
+  for (int i = 0; i < histogram.count_size(); ++i) {
+    seen += histogram.count(i);
+    if (seen >= rank)
+      return histogram.interval_size_usec() * (i + 1 < histogram.count_size() ? i + 1 : i);
+  }
+  return 0;
+}
+
+// Recycles pre-aligned SRGBA pixel buffers so that camera frames can be
+// converted straight into memory an ImageFrame owns, without allocating a new
+// frame for every camera read. Frames handed out by `acquire` give their
+// buffer back to the pool when they are destroyed, no matter which thread
+// (graph or caller) drops the last reference.
+class ImageFramePool {
+  private:
+  using Buffer = std::unique_ptr<uint8_t[], mediapipe::ImageFrame::Deleter>;
+
+  struct Storage {
+    std::mutex m;
+    std::vector<Buffer> free_buffers;
+  };
+
+  std::shared_ptr<Storage> storage;
+  int width = 0;
+  int height = 0;
+  int width_step = 0;
+
+  public:
+  static constexpr int kInitialSize = 3;
+
+  std::unique_ptr<mediapipe::ImageFrame> acquire(int frame_width, int frame_height) {
+    // Drop every buffer of the previous geometry. Frames still in flight keep
+    // the old storage alive until they are released.
+    if (!this->storage || frame_width != this->width || frame_height != this->height) {
+      this->storage = std::make_shared<Storage>();
+      this->width = frame_width;
+      this->height = frame_height;
+      for (int i = 0; i < kInitialSize; ++i)
+        this->storage->free_buffers.push_back(allocate());
+    }
+
+    Buffer buffer;
+    {
+      std::lock_guard<std::mutex> lg(this->storage->m);
+      if (!this->storage->free_buffers.empty()) {
+        buffer = std::move(this->storage->free_buffers.back());
+        this->storage->free_buffers.pop_back();
+      }
+    }
+    // Only happens if the graph holds on to more frames than the pool size.
+    if (!buffer)
+      buffer = allocate();
+
+    mediapipe::ImageFrame::Deleter release = buffer.get_deleter();
+    std::shared_ptr<Storage> owner = this->storage;
+    return absl::make_unique<mediapipe::ImageFrame>(
+      mediapipe::ImageFormat::SRGBA, this->width, this->height, this->width_step,
+      buffer.release(),
+      [owner, release](uint8_t* pixel_data) {
+        std::lock_guard<std::mutex> lg(owner->m);
+        owner->free_buffers.emplace_back(pixel_data, release);
+      });
+  }
+
+  private:
+  Buffer allocate() {
+    mediapipe::ImageFrame frame(
+      mediapipe::ImageFormat::SRGBA, this->width, this->height,
+      mediapipe::ImageFrame::kGlDefaultAlignmentBoundary);
+    this->width_step = frame.WidthStep();
+    return frame.Release();
+  }
+};
+
+// Restricts the calling thread to `cores` for as long as the object lives and
+// restores the previous mask afterwards. Threads created in between inherit
+// the restricted mask.
+class ScopedCpuAffinity {
+  private:
+  bool pinned = false;
+  cpu_set_t previous_cpu_set;
+
+  public:
+  explicit ScopedCpuAffinity(const std::vector<int>& cores) {
+    if (cores.empty())
+      return;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &this->previous_cpu_set) != 0)
+      return;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int core : cores) {
+      // CPU_SET does not check its argument.
+      if (core < 0 || core >= CPU_SETSIZE) {
+        std::cerr << "Ignoring core " << core << ", not in [0, " << CPU_SETSIZE << ")." << std::endl;
+        continue;
+      }
+      CPU_SET(core, &cpu_set);
+    }
+    this->pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) == 0;
+    if (!this->pinned)
+      std::cerr << "Failed to pin the graph threads, running them unpinned." << std::endl;
+  }
+
+  ~ScopedCpuAffinity() {
+    if (this->pinned)
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &this->previous_cpu_set);
+  }
+};
+
 class MPPGraphRunner {
   private:
+  // Outputs of a single timestamp, collected from the stream observers until
+  // every stream has reported.
+  struct PendingResult {
+    MPPGraphResult result;
+    bool has_video = false;
+    bool has_presence = false;
+    bool has_landmarks = false;
+  };
+  static constexpr size_t kMaxPendingResults = 8;
+  static constexpr size_t kResultQueueSize = 4;
+  // How long `awaitResult` waits for a frame the flow limiter may have dropped
+  static constexpr std::chrono::milliseconds kResultTimeout{1000};
+
   mediapipe::CalculatorGraph graph;
   mediapipe::GlCalculatorHelper gpu_helper;
+  ImageFramePool frame_pool;
+  MPPGraphBackend backend = MPPGraphBackend::GPU;
+  bool headless = false;
+  bool async = false;
   std::unique_ptr<mediapipe::OutputStreamPoller> poller_video;
   std::unique_ptr<mediapipe::OutputStreamPoller> poller_landmarks;
   std::unique_ptr<mediapipe::OutputStreamPoller> poller_landmark_presence;
 
+  // Asynchronous mode only. Observer callbacks run on graph threads and
+  // `pollResult`/`awaitResult` on the caller's, so the pending map and the
+  // finished results are both guarded by `pending_m`.
+  std::mutex pending_m;
+  std::condition_variable results_cv;
+  std::map<int64_t, PendingResult> pending;
+  std::deque<MPPGraphResult> results;
+  size_t dropped_results = 0;
+
+  // Profiling only. A thread of its own summarizes the profiler every
+  // `profile_interval` and writes the trace, off the capture thread.
+  std::string profile_path;
+  std::chrono::seconds profile_interval{0};
+  std::thread profile_thread;
+  std::mutex profile_m;
+  std::condition_variable profile_cv;
+  bool profile_stop = false;
+
   public:
-  absl::Status initMPPGraph(std::string calculator_graph_config_file) {
-    MP_RETURN_IF_ERROR(createGraphFromFile(calculator_graph_config_file, graph));
+  ~MPPGraphRunner() {
+    if (this->profile_thread.joinable()) {
+      {
+        std::lock_guard<std::mutex> lg(this->profile_m);
+        this->profile_stop = true;
+      }
+      this->profile_cv.notify_one();
+      this->profile_thread.join();
+    }
+    // Closing the graph stops the profiler, which writes the last trace.
+    this->graph.CloseAllPacketSources().IgnoreError();
+    this->graph.WaitUntilDone().IgnoreError();
+  }
 
-    MP_ASSIGN_OR_RETURN(auto gpu_resources, mediapipe::GpuResources::Create());
-    MP_RETURN_IF_ERROR(graph.SetGpuResources(std::move(gpu_resources)));
-    gpu_helper.InitializeForTest(graph.GetGpuResources().get());
+  absl::Status initMPPGraph(mediapipe::CalculatorGraphConfig config, const MPPGraphOptions& options) {
+    setResourceProvider(options.resource_provider);
 
-    MP_ASSIGN_OR_RETURN(mediapipe::OutputStreamPoller poller_video_,
-      graph.AddOutputStreamPoller(kVideoOutputStream));
-    this->poller_video = std::make_unique<mediapipe::OutputStreamPoller>(std::move(poller_video_));
+    if (!options.profile_path.empty()) {
+      MP_RETURN_IF_ERROR(enableProfiler(options.profile_path, config));
+      this->profile_path = options.profile_path;
+      this->profile_interval = std::chrono::seconds(std::max(1, options.profile_summary_interval_s));
+    }
+
+    // Every thread the graph spawns from here on (executor threads, and the
+    // XNNPACK thread pools the inference calculators create when they open)
+    // inherits the affinity of this thread.
+    ScopedCpuAffinity cpu_affinity(options.cpu_cores);
+
+    MP_RETURN_IF_ERROR(graph.Initialize(config));
+
+    this->backend = options.backend;
+    if (this->backend == MPPGraphBackend::GPU) {
+      MP_ASSIGN_OR_RETURN(auto gpu_resources, mediapipe::GpuResources::Create());
+      MP_RETURN_IF_ERROR(graph.SetGpuResources(std::move(gpu_resources)));
+      gpu_helper.InitializeForTest(graph.GetGpuResources().get());
+    }
+
+    // A headless graph has no "output_video" stream at all, so nothing is
+    // rendered and nothing is read back from the GPU.
+    this->headless = options.headless;
+    this->async = options.async;
+
+    if (options.async) {
+      if (!this->headless) {
+        MP_RETURN_IF_ERROR(graph.ObserveOutputStream(kVideoOutputStream,
+          [this](const mediapipe::Packet& packet) -> absl::Status {
+            cv::Mat output_frame_mat;
+            MP_RETURN_IF_ERROR(this->readVideoPacket(packet, output_frame_mat));
+            this->collect(packet.Timestamp(), [&output_frame_mat](PendingResult& pending_result) {
+              pending_result.result.output_frame = std::move(output_frame_mat);
+              pending_result.has_video = true;
+            });
+            return absl::OkStatus();
+          }));
+      }
+
+      MP_RETURN_IF_ERROR(graph.ObserveOutputStream(kLandmarksOutputStream,
+        [this](const mediapipe::Packet& packet) -> absl::Status {
+          // DMSLandmarksCalculator already picked the landmarks in the graph.
+          const auto& landmarks = packet.Get<DMSLandmarks>();
+          this->collect(packet.Timestamp(), [&landmarks](PendingResult& pending_result) {
+            pending_result.result.landmarks = landmarks;
+            pending_result.has_landmarks = true;
+          });
+          return absl::OkStatus();
+        }));
 
-    MP_ASSIGN_OR_RETURN(mediapipe::OutputStreamPoller poller_landmarks_,
-      graph.AddOutputStreamPoller(kLandmarksOutputStream));
-    this->poller_landmarks = std::make_unique<mediapipe::OutputStreamPoller>(std::move(poller_landmarks_));
+      MP_RETURN_IF_ERROR(graph.ObserveOutputStream(kLandmarkPresenceOutputStream,
+        [this](const mediapipe::Packet& packet) -> absl::Status {
+          const bool landmark_presence = packet.Get<bool>();
+          this->collect(packet.Timestamp(), [landmark_presence](PendingResult& pending_result) {
+            pending_result.result.landmark_presence = landmark_presence;
+            pending_result.has_presence = true;
+          });
+          return absl::OkStatus();
+        }));
+    }
+    else {
+      if (!this->headless) {
+        MP_ASSIGN_OR_RETURN(mediapipe::OutputStreamPoller poller_video_,
+          graph.AddOutputStreamPoller(kVideoOutputStream));
+        this->poller_video = std::make_unique<mediapipe::OutputStreamPoller>(std::move(poller_video_));
+      }
 
-    MP_ASSIGN_OR_RETURN(mediapipe::OutputStreamPoller poller_landmark_presence_,
-      graph.AddOutputStreamPoller(kLandmarkPresenceOutputStream));
-    this->poller_landmark_presence = std::make_unique<mediapipe::OutputStreamPoller>(std::move(poller_landmark_presence_));
+      MP_ASSIGN_OR_RETURN(mediapipe::OutputStreamPoller poller_landmarks_,
+        graph.AddOutputStreamPoller(kLandmarksOutputStream));
+      this->poller_landmarks = std::make_unique<mediapipe::OutputStreamPoller>(std::move(poller_landmarks_));
+
+      MP_ASSIGN_OR_RETURN(mediapipe::OutputStreamPoller poller_landmark_presence_,
+        graph.AddOutputStreamPoller(kLandmarkPresenceOutputStream));
+      this->poller_landmark_presence = std::make_unique<mediapipe::OutputStreamPoller>(std::move(poller_landmark_presence_));
+    }
 
     MP_RETURN_IF_ERROR(graph.StartRun({}));
 
+    if (!this->profile_path.empty())
+      this->profile_thread = std::thread(&MPPGraphRunner::profileLoop, this);
+
     return absl::OkStatus();
   }
 
+  absl::Status submitFrame(cv::Mat& camera_frame, size_t frame_timestamp_us) {
+    // Write the camera frame straight into a pooled ImageFrame. A BGR frame
+    // from cv::VideoCapture is converted in the same pass, so there is no
+    // intermediate RGBA Mat and no per-frame allocation.
+    std::unique_ptr<mediapipe::ImageFrame> input_frame =
+      this->frame_pool.acquire(camera_frame.cols, camera_frame.rows);
+    cv::Mat input_frame_mat = mediapipe::formats::MatView(input_frame.get());
+    if (camera_frame.channels() == 3)
+      cv::cvtColor(camera_frame, input_frame_mat, cv::COLOR_BGR2RGBA);
+    else
+      camera_frame.copyTo(input_frame_mat);
+
+    // The CPU graph adopts the pooled frame itself.
+    if (this->backend == MPPGraphBackend::CPU) {
+      return this->graph.AddPacketToInputStream(
+        kInputStream,
+        mediapipe::Adopt(input_frame.release()).At(mediapipe::Timestamp(frame_timestamp_us)));
+    }
+
+    return this->gpu_helper.RunInGlContext([&input_frame, &frame_timestamp_us, this]() -> absl::Status {
+      // Convert ImageFrame to GpuBuffer.
+      auto texture = this->gpu_helper.CreateSourceTexture(*input_frame.get());
+      auto gpu_frame = texture.GetFrame<mediapipe::GpuBuffer>();
+      glFlush();
+      texture.Release();
+
+      // Send GPU image packet into the graph.
+      return this->graph.AddPacketToInputStream(
+        kInputStream,
+        mediapipe::Adopt(gpu_frame.release()).At(mediapipe::Timestamp(frame_timestamp_us)));
+    });
+  }
+
+  bool pollResult(MPPGraphResult& result) {
+    std::lock_guard<std::mutex> lg(this->pending_m);
+    return this->popResult(result);
+  }
+
+  bool isAsync() const {
+    return this->async;
+  }
+
+  // Asynchronous mode only. Waits for the result of `frame_timestamp_us`,
+  // dropping any older result still queued in front of it.
+  absl::Status awaitResult(size_t frame_timestamp_us, MPPGraphResult& result) {
+    std::unique_lock<std::mutex> lock(this->pending_m);
+    const auto deadline = std::chrono::steady_clock::now() + kResultTimeout;
+    while (true) {
+      if (this->popResult(result)) {
+        if (result.timestamp_us == frame_timestamp_us)
+          return absl::OkStatus();
+        continue;
+      }
+      if (this->results_cv.wait_until(lock, deadline) == std::cv_status::timeout)
+        return absl::DeadlineExceededError("No result for the frame.");
+    }
+  }
+
   absl::Status processFrame(
     cv::Mat& camera_frame,
     size_t frame_timestamp_us,
     cv::Mat& output_frame_mat,
-    ::mediapipe::NormalizedLandmarkList& landmarks,
+    DMSLandmarks& landmarks,
     bool& landmark_presence
   ) {
-    // Wrap Mat into an ImageFrame.
-    auto input_frame = absl::make_unique<mediapipe::ImageFrame>(
-      mediapipe::ImageFormat::SRGBA, camera_frame.cols, camera_frame.rows,
-      mediapipe::ImageFrame::kGlDefaultAlignmentBoundary);
-    cv::Mat input_frame_mat = mediapipe::formats::MatView(input_frame.get());
-    camera_frame.copyTo(input_frame_mat);    
-    MP_RETURN_IF_ERROR(
-      this->gpu_helper.RunInGlContext([&input_frame, &frame_timestamp_us, this]() -> absl::Status {
-        // Convert ImageFrame to GpuBuffer.
-        auto texture = this->gpu_helper.CreateSourceTexture(*input_frame.get());
-        auto gpu_frame = texture.GetFrame<mediapipe::GpuBuffer>();
-        glFlush();
-        texture.Release();
+    // A rejected input packet is not fatal here; the caller's loop keeps
+    // going with the next camera frame.
+    this->submitFrame(camera_frame, frame_timestamp_us).IgnoreError();
 
-        // Send GPU image packet into the graph.
-        auto status = this->graph.AddPacketToInputStream(
-          kInputStream,
-          mediapipe::Adopt(gpu_frame.release()).At(mediapipe::Timestamp(frame_timestamp_us)));
-        // ABSL_LOG(INFO) << status;
-        
-        return absl::OkStatus();
-      }));
-    
     // Get the graph result packet, or stop if that fails
+    // Every graph emits landmark presence for every frame, so wait for it
+    // rather than peeking at the queue, which may still be empty while the
+    // graph finishes the frame.
     mediapipe::Packet packet_video, packet_landmarks, packet_landmark_presence;
-    this->poller_video->Next(&packet_video);
-    if (this->poller_landmark_presence->QueueSize() > 0) {
-      this->poller_landmark_presence->Next(&packet_landmark_presence);
-      landmark_presence = packet_landmark_presence.Get<bool>();
-      if (landmark_presence) {
-        this->poller_landmarks->Next(&packet_landmarks);
-        landmarks = packet_landmarks.Get<::mediapipe::NormalizedLandmarkList>();
-      }
+    if (!this->headless)
+      this->poller_video->Next(&packet_video);
+    if (!this->poller_landmark_presence->Next(&packet_landmark_presence))
+      return absl::UnavailableError("The graph stopped before the frame was done.");
+    landmark_presence = packet_landmark_presence.Get<bool>();
+    if (landmark_presence) {
+      this->poller_landmarks->Next(&packet_landmarks);
+      landmarks = packet_landmarks.Get<DMSLandmarks>();
     }
-	
+
+    if (this->headless) {
+      output_frame_mat.release();
+      return absl::OkStatus();
+    }
+    return this->readVideoPacket(packet_video, output_frame_mat);
+  }
+
+  private:
+  // Reads the rendered frame (read back from the GPU first if needed) and
+  // converts it to a BGR Mat for display or saving.
+  absl::Status readVideoPacket(const mediapipe::Packet& packet_video, cv::Mat& output_frame_mat) {
+    if (this->backend == MPPGraphBackend::CPU) {
+      convertToBGR(mediapipe::formats::MatView(&packet_video.Get<mediapipe::ImageFrame>()), output_frame_mat);
+      return absl::OkStatus();
+    }
+
     // Convert GpuBuffer to ImageFrame.
     std::unique_ptr<mediapipe::ImageFrame> output_frame;
     MP_RETURN_IF_ERROR(
@@ -168,26 +573,151 @@ class MPPGraphRunner {
         return absl::OkStatus();
       }));
     // Convert back to opencv for display or saving.
-    output_frame_mat = mediapipe::formats::MatView(output_frame.get());
-    if (output_frame_mat.channels() == 4)
-      cv::cvtColor(output_frame_mat, output_frame_mat, cv::COLOR_RGBA2BGR);
+    convertToBGR(mediapipe::formats::MatView(output_frame.get()), output_frame_mat);
+
+    return absl::OkStatus();
+  }
+
+  static void convertToBGR(const cv::Mat& output_frame_view, cv::Mat& output_frame_mat) {
+    if (output_frame_view.channels() == 4)
+      cv::cvtColor(output_frame_view, output_frame_mat, cv::COLOR_RGBA2BGR);
     else
-      cv::cvtColor(output_frame_mat, output_frame_mat, cv::COLOR_RGB2BGR);
-    
+      cv::cvtColor(output_frame_view, output_frame_mat, cv::COLOR_RGB2BGR);
+  }
+
+  void profileLoop() {
+    const std::string summary_path = this->profile_path + "/" + kProfileSummaryFile;
+    std::ofstream summary(summary_path, std::ios::app);
+    if (!summary)
+      std::cerr << "Unable to write " << summary_path << ", only the trace is kept." << std::endl;
+
+    auto summarized = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(this->profile_m);
+    while (!this->profile_cv.wait_for(lock, this->profile_interval, [this] { return this->profile_stop; })) {
+      const auto now = std::chrono::steady_clock::now();
+      const int64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - summarized).count();
+      summarized = now;
+
+      absl::Status status = absl::OkStatus();
+      if (summary)
+        status = this->writeProfileSummary(summary, elapsed_us);
+      if (status.ok())
+        status = this->graph.profiler()->WriteProfile();
+      if (!status.ok()) {
+        std::cerr << "Failed to write the graph profile." << status.message() << std::endl;
+        return;
+      }
+    }
+  }
+
+  // Appends one line per calculator that ran since the last summary: how
+  // often it ran, its Process() p50/p95/p99, and the p95 of the time its
+  // input packets waited to be processed, in microseconds. `queue` is the
+  // average number of packets waiting in front of it (total wait over
+  // elapsed time) on its busiest input stream.
+  absl::Status writeProfileSummary(std::ofstream& summary, int64_t elapsed_us) {
+    std::vector<mediapipe::CalculatorProfile> profiles;
+    MP_RETURN_IF_ERROR(this->graph.profiler()->GetCalculatorProfiles(&profiles));
+
+    summary << "--- " << std::fixed << std::setprecision(1) << elapsed_us / 1e6 << " s" << std::endl;
+    for (const mediapipe::CalculatorProfile& profile : profiles) {
+      const mediapipe::TimeHistogram& runtime = profile.process_runtime();
+      int64_t runs = 0;
+      for (int64_t count : runtime.count())
+        runs += count;
+      if (runs == 0)
+        continue;
+
+      int64_t wait_p95 = 0;
+      double queue = 0.;
+      for (const mediapipe::StreamProfile& stream : profile.input_stream_profiles()) {
+        if (stream.back_edge())
+          continue;
+        int64_t packets = 0;
+        for (int64_t count : stream.latency().count())
+          packets += count;
+        if (packets == 0)
+          continue;
+        wait_p95 = std::max(wait_p95, histogramPercentile(stream.latency(), packets, 0.95));
+        queue = std::max(queue, static_cast<double>(stream.latency().total()) / elapsed_us);
+      }
+
+      summary << std::left << std::setw(48) << profile.name() << std::right
+        << " n=" << std::setw(5) << runs
+        << " p50=" << std::setw(6) << histogramPercentile(runtime, runs, 0.50)
+        << " p95=" << std::setw(6) << histogramPercentile(runtime, runs, 0.95)
+        << " p99=" << std::setw(6) << histogramPercentile(runtime, runs, 0.99)
+        << " wait95=" << std::setw(6) << wait_p95
+        << " queue=" << std::setprecision(2) << queue << std::setprecision(1) << std::endl;
+    }
     return absl::OkStatus();
   }
+
+  // Caller holds `pending_m`.
+  bool popResult(MPPGraphResult& result) {
+    if (this->results.empty())
+      return false;
+    result = std::move(this->results.front());
+    this->results.pop_front();
+    return true;
+  }
+
+  // Applies `update` to the pending result of `timestamp` and hands the result
+  // over to the consumer once video, presence and (if present) landmarks are
+  // all in.
+  template <typename Update>
+  void collect(mediapipe::Timestamp timestamp, Update update) {
+    std::lock_guard<std::mutex> lg(this->pending_m);
+    PendingResult& pending_result = this->pending[timestamp.Value()];
+    update(pending_result);
+
+    const bool complete = (this->headless || pending_result.has_video) && pending_result.has_presence &&
+      (!pending_result.result.landmark_presence || pending_result.has_landmarks);
+    if (complete) {
+      pending_result.result.timestamp_us = timestamp.Value();
+      // A consumer that falls behind loses its oldest result, not the newest.
+      if (this->results.size() >= kResultQueueSize) {
+        this->results.pop_front();
+        if (this->dropped_results++ % 100 == 0)
+          std::cerr << "Dropped " << this->dropped_results << " graph results the consumer did not pick up."
+            << std::endl;
+      }
+      this->results.push_back(std::move(pending_result.result));
+      this->pending.erase(timestamp.Value());
+      this->results_cv.notify_one();
+    }
+    // Never let a timestamp that lost one of its outputs pile up.
+    while (this->pending.size() > kMaxPendingResults)
+      this->pending.erase(this->pending.begin());
+  }
 };
 
-bool MPPGraphRunnerWrapper::initMPPGraph(std::string calculator_graph_config_file) {
+bool MPPGraphRunnerWrapper::initMPPGraph(std::string calculator_graph_config_file, const MPPGraphOptions& options) {
   this->core_runner_ptr = static_cast<void*>(new MPPGraphRunner());
   MPPGraphRunner& runner = *(static_cast<MPPGraphRunner*>(this->core_runner_ptr));
 
-  absl::Status status = runner.initMPPGraph(calculator_graph_config_file);
+  mediapipe::CalculatorGraphConfig config;
+  absl::Status status = readGraphConfigFile(calculator_graph_config_file, config);
+  if (status.ok())
+    status = runner.initMPPGraph(config, options);
   if (!status.ok())
     std::cerr << "Failed to initialize the graph." << status.message() << std::endl;
   
   return status.ok();
 }
+bool MPPGraphRunnerWrapper::initMPPGraph(MPPGraphConfig graph_config, const MPPGraphOptions& options) {
+  this->core_runner_ptr = static_cast<void*>(new MPPGraphRunner());
+  MPPGraphRunner& runner = *(static_cast<MPPGraphRunner*>(this->core_runner_ptr));
+
+  mediapipe::CalculatorGraphConfig config;
+  absl::Status status = readEmbeddedGraphConfig(graph_config, config);
+  if (status.ok())
+    status = runner.initMPPGraph(config, options);
+  if (!status.ok())
+    std::cerr << "Failed to initialize the graph." << status.message() << std::endl;
+
+  return status.ok();
+}
 bool MPPGraphRunnerWrapper::processFrame(
   cv::Mat& camera_frame,
   size_t frame_timestamp_us,
@@ -195,22 +725,41 @@ bool MPPGraphRunnerWrapper::processFrame(
   DMSLandmarks& dms_landmarks,
   bool& landmark_presence) {
   MPPGraphRunner& runner = *(static_cast<MPPGraphRunner*>(this->core_runner_ptr));
-  ::mediapipe::NormalizedLandmarkList landmarks_;
-  absl::Status status = runner.processFrame(camera_frame, frame_timestamp_us, output_frame_mat, landmarks_, landmark_presence);
-  if (!status.ok()) {
-    std::cerr << "Failed to process the frame." << status.message() << std::endl;
-    return status.ok();
-  }
-
-  if (landmark_presence) {
-    for (int i = 0; i < 18; ++i) {
-      dms_landmarks.landmarks[i].x = landmarks_.landmark(landmark_converting_table[i]).x();
-      dms_landmarks.landmarks[i].y = landmarks_.landmark(landmark_converting_table[i]).y();
-      dms_landmarks.landmarks[i].z = landmarks_.landmark(landmark_converting_table[i]).z();
+  if (runner.isAsync()) {
+    // Same round trip on a graph that was started for `submitFrame`, so one
+    // graph can serve both single frames and a streaming loop.
+    MPPGraphResult result;
+    absl::Status status = runner.submitFrame(camera_frame, frame_timestamp_us);
+    if (status.ok())
+      status = runner.awaitResult(frame_timestamp_us, result);
+    if (!status.ok()) {
+      std::cerr << "Failed to process the frame." << status.message() << std::endl;
+      return false;
     }
+    output_frame_mat = std::move(result.output_frame);
+    landmark_presence = result.landmark_presence;
+    if (landmark_presence)
+      dms_landmarks = result.landmarks;
+    return true;
   }
+  absl::Status status = runner.processFrame(camera_frame, frame_timestamp_us, output_frame_mat, dms_landmarks, landmark_presence);
+  if (!status.ok())
+    std::cerr << "Failed to process the frame." << status.message() << std::endl;
+
   return status.ok();
 }
+bool MPPGraphRunnerWrapper::submitFrame(cv::Mat& camera_frame, size_t frame_timestamp_us) {
+  MPPGraphRunner& runner = *(static_cast<MPPGraphRunner*>(this->core_runner_ptr));
+  absl::Status status = runner.submitFrame(camera_frame, frame_timestamp_us);
+  if (!status.ok())
+    std::cerr << "Failed to submit the frame." << status.message() << std::endl;
+
+  return status.ok();
+}
+bool MPPGraphRunnerWrapper::pollResult(MPPGraphResult& result) {
+  MPPGraphRunner& runner = *(static_cast<MPPGraphRunner*>(this->core_runner_ptr));
+  return runner.pollResult(result);
+}
 MPPGraphRunnerWrapper::~MPPGraphRunnerWrapper() {
   delete static_cast<MPPGraphRunner*>(this->core_runner_ptr);
 }
@@ -0,0 +1,45 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts every global operator new of the program. Replaces the global
+// allocation functions, so include it from exactly one source per binary.
+namespace alloc_counter {
+	inline std::atomic<size_t> allocations{0};
+
+	inline size_t count() {
+		return allocations.load(std::memory_order_relaxed);
+	}
+}
+
+void* operator new(std::size_t size) {
+	alloc_counter::allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+#endif
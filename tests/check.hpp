@@ -0,0 +1,16 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cstdlib>
+#include <iostream>
+
+// Fails the test with the location of `condition` if it does not hold.
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+			std::exit(1); \
+		} \
+	} while (0)
+
+#endif
@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "descriptor_matcher.hpp"
+
+// Time of one query against N enrolled descriptors: a plain row-major
+// loop, as the recognizer computed distances before the blocked
+// layout, against DescriptorMatcher::squaredDistances.
+namespace {
+	constexpr size_t DIM = dms::DescriptorMatcher::DIM;
+
+	void scalarSquaredDistances(const float* descriptors, const size_t count, const float* query, float* distances) {
+		for (size_t n = 0; n < count; n++, descriptors += DIM) {
+			float sum = 0.f;
+			for (size_t k = 0; k < DIM; k++) {
+				const float d = descriptors[k] - query[k];
+				sum += d * d;
+			}
+			distances[n] = sum;
+		}
+	}
+
+	// Mean microseconds per call of `f` over enough calls to take ~`budget`
+	template <typename F>
+	double usPerCall(F f, const std::chrono::milliseconds budget) {
+		using Clock = std::chrono::steady_clock;
+		f(); // Warm the caches
+		size_t calls = 0;
+		const Clock::time_point start = Clock::now();
+		Clock::time_point now = start;
+		do {
+			f();
+			calls++;
+			now = Clock::now();
+		} while (now - start < budget);
+		return std::chrono::duration<double, std::micro>(now - start).count() / calls;
+	}
+}
+
+int main(int argc, char** argv) {
+	const std::chrono::milliseconds budget(argc > 1 ? std::strtol(argv[1], nullptr, 10) : 200);
+	std::mt19937 rng(42);
+	std::normal_distribution<float> distribution(0.f, 0.1f);
+
+	std::cout << "descriptors   scalar us  blocked us  speedup" << std::endl;
+	for (const size_t count : { 10, 100, 1000, 10000, 100000 }) {
+		std::vector<float> descriptors(count * DIM);
+		for (float& v : descriptors)
+			v = distribution(rng);
+		std::vector<float> query(DIM);
+		for (float& v : query)
+			v = distribution(rng);
+
+		const dms::DescriptorMatcher matcher(descriptors.data(), count, {});
+		std::vector<float> distances(matcher.paddedSize());
+		volatile float sink = 0;
+
+		const double scalar = usPerCall([&] {
+			scalarSquaredDistances(descriptors.data(), count, query.data(), distances.data());
+			sink = distances[count - 1];
+		}, budget);
+		const double blocked = usPerCall([&] {
+			matcher.squaredDistances(query.data(), distances.data());
+			sink = distances[count - 1];
+		}, budget);
+
+		std::cout << std::setw(11) << count << std::fixed << std::setprecision(2)
+		          << std::setw(12) << scalar << std::setw(12) << blocked
+		          << std::setw(9) << scalar / blocked << "x" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "descriptor_matcher.hpp"
+
+using dms::DescriptorMatcher;
+
+namespace {
+	constexpr size_t DIM = DescriptorMatcher::DIM;
+
+	std::vector<float> randomDescriptors(const size_t count, std::mt19937& rng) {
+		std::normal_distribution<float> distribution(0.f, 0.1f);
+		std::vector<float> descriptors(count * DIM);
+		for (float& v : descriptors)
+			v = distribution(rng);
+		return descriptors;
+	}
+
+	// Row-major reference in double precision
+	double squaredDistance(const float* a, const float* b) {
+		double sum = 0;
+		for (size_t k = 0; k < DIM; k++) {
+			const double d = static_cast<double>(a[k]) - b[k];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	bool near(const double actual, const double expected) {
+		return std::fabs(actual - expected) <= 1e-5 * std::max(1.0, std::fabs(expected));
+	}
+
+	void testSquaredDistancesMatchScalar(const size_t count, std::mt19937& rng) {
+		const std::vector<float> descriptors = randomDescriptors(count, rng);
+		const std::vector<float> query = randomDescriptors(1, rng);
+		const DescriptorMatcher matcher(descriptors.data(), count, {});
+		CHECK(matcher.size() == count);
+		CHECK(matcher.paddedSize() % DescriptorMatcher::BLOCK == 0);
+		CHECK(matcher.paddedSize() >= count && matcher.paddedSize() < count + DescriptorMatcher::BLOCK);
+
+		std::vector<float> distances(matcher.paddedSize());
+		matcher.squaredDistances(query.data(), distances.data());
+		for (size_t n = 0; n < count; n++)
+			CHECK(near(distances[n], squaredDistance(descriptors.data() + n * DIM, query.data())));
+
+		// A query equal to an enrolled descriptor is at distance zero from it.
+		matcher.squaredDistances(descriptors.data() + (count - 1) * DIM, distances.data());
+		CHECK(distances[count - 1] == 0.f);
+	}
+
+	void testMatchMatchesScalar(std::mt19937& rng) {
+		// Drivers of uneven sizes, so ranges straddle block boundaries.
+		const std::vector<dms::DescriptorRange> ranges = { { 0, 5 }, { 5, 17 }, { 22, 1 }, { 23, 0 }, { 23, 30 } };
+		const size_t count = 53;
+		const std::vector<float> descriptors = randomDescriptors(count, rng);
+		const std::vector<float> query = randomDescriptors(1, rng);
+		const DescriptorMatcher matcher(descriptors.data(), count, ranges);
+
+		for (const size_t k : { size_t(0), size_t(3) }) {
+			for (const auto aggregation : { DescriptorMatcher::Aggregation::MEAN, DescriptorMatcher::Aggregation::MIN }) {
+				const std::vector<DescriptorMatcher::Match> matches = matcher.match(query.data(), k, aggregation);
+				CHECK(matches.size() == ranges.size() - 1); // The empty driver is skipped
+				for (size_t i = 0; i < matches.size(); i++) {
+					const dms::DescriptorRange range = ranges[matches[i].driver];
+					std::vector<double> distances;
+					for (uint32_t n = range.first; n < range.first + range.count; n++)
+						distances.push_back(std::sqrt(squaredDistance(descriptors.data() + n * DIM, query.data())));
+					std::sort(distances.begin(), distances.end());
+
+					double expected = distances[0];
+					if (aggregation == DescriptorMatcher::Aggregation::MEAN) {
+						const size_t used = k != 0 && k < distances.size() ? k : distances.size();
+						expected = 0;
+						for (size_t j = 0; j < used; j++)
+							expected += distances[j];
+						expected /= used;
+					}
+					CHECK(near(matches[i].distance, expected));
+					if (i > 0) CHECK(matches[i - 1].distance <= matches[i].distance);
+				}
+			}
+		}
+	}
+
+	void testEmpty() {
+		const DescriptorMatcher matcher(nullptr, 0, {});
+		CHECK(matcher.size() == 0);
+		CHECK(matcher.paddedSize() == 0);
+		const std::vector<float> query(DIM, 0.f);
+		CHECK(matcher.match(query.data(), 0, DescriptorMatcher::Aggregation::MEAN).empty());
+	}
+}
+
+int main() {
+	std::mt19937 rng(42);
+	for (const size_t count : { 1, 7, 15, 16, 17, 31, 32, 33, 100, 1000, 1009 })
+		testSquaredDistancesMatchScalar(count, rng);
+	testMatchMatchesScalar(rng);
+	testEmpty();
+	return 0;
+}
@@ -0,0 +1,122 @@
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "driver_database.hpp"
+
+namespace {
+	std::vector<dlib::matrix<float, 0, 1>> descriptors(const size_t count, const float seed) {
+		std::vector<dlib::matrix<float, 0, 1>> emb_vecs(count);
+		for (size_t i = 0; i < count; i++) {
+			emb_vecs[i].set_size(dms::EmbeddingStore::DIM);
+			for (long k = 0; k < emb_vecs[i].size(); k++)
+				emb_vecs[i](k) = seed + i + k / 1000.f;
+		}
+		return emb_vecs;
+	}
+
+	// Writes a driver in the format registration used before the embedding store.
+	void writeLegacyDriver(const std::string& path, const std::vector<dlib::matrix<float, 0, 1>>& emb_vecs) {
+		std::ofstream ofs(path, std::ios::binary);
+		size_t num_embedding_vectors = emb_vecs.size();
+		ofs.write(reinterpret_cast<const char*>(&num_embedding_vectors), sizeof(num_embedding_vectors));
+		for (const auto& descriptor : emb_vecs) {
+			size_t num_rows = descriptor.nr();
+			size_t num_cols = descriptor.nc();
+			ofs.write(reinterpret_cast<const char*>(&num_rows), sizeof(num_rows));
+			ofs.write(reinterpret_cast<const char*>(&num_cols), sizeof(num_cols));
+			ofs.write(reinterpret_cast<const char*>(descriptor.begin()), num_rows * num_cols * sizeof(float));
+		}
+	}
+
+	bool exists(const std::string& path) {
+		return access(path.c_str(), F_OK) == 0;
+	}
+
+	std::string makeTempDir() {
+		char dir[] = "/tmp/driver_database_test.XXXXXX";
+		CHECK(mkdtemp(dir) != nullptr);
+		return std::string(dir) + "/";
+	}
+
+	void testImportsLegacyDrivers() {
+		const std::string dir = makeTempDir();
+		const auto first = descriptors(4, 1.f);
+		const auto third = descriptors(5, 3.f);
+		writeLegacyDriver(dir + "1.bin", first);
+		writeLegacyDriver(dir + "3.bin", third);
+		{
+			std::ofstream truncated(dir + "2.bin", std::ios::binary);
+			truncated << "junk";
+		}
+
+		dms::DriverDatabase database(dir + "drivers.emb");
+		std::shared_ptr<const dms::EmbeddingStore> store = database.snapshot();
+		CHECK(store);
+		CHECK(store->numDrivers() == 2);
+		CHECK(std::string(store->driver(0).name) == "1");
+		CHECK(std::string(store->driver(1).name) == "3");
+		CHECK(store->driver(1).num_vectors == third.size());
+		CHECK(store->vector(store->driver(1).first_vector + 2)[7] == third[2](7));
+
+		// Imported once; later starts read the store and can keep appending.
+		CHECK(std::remove((dir + "1.bin").c_str()) == 0);
+		dms::DriverDatabase reopened(dir + "drivers.emb");
+		CHECK(reopened.snapshot()->numDrivers() == 2);
+		CHECK(reopened.append("new", descriptors(4, 9.f)) == 2);
+		CHECK(!exists(dir + "drivers.emb.tmp"));
+	}
+
+	void testNamesAreUnique() {
+		const std::string dir = makeTempDir();
+		writeLegacyDriver(dir + "2.bin", descriptors(4, 2.f));
+		dms::DriverDatabase database(dir + "drivers.emb");
+		CHECK(database.snapshot()->numDrivers() == 1);
+
+		// Unnamed drivers are numbered past the imported "2".
+		CHECK(database.append("", descriptors(4, 1.f)) == 1);
+		CHECK(std::string(database.snapshot()->driver(1).name) == "3");
+		CHECK(database.append("", descriptors(4, 1.f)) == 2);
+		CHECK(std::string(database.snapshot()->driver(2).name) == "4");
+
+		CHECK(database.append("2", descriptors(4, 1.f)) == -EEXIST);
+		CHECK(database.append(std::string(dms::DriverRecord::MAX_NAME_LENGTH + 1, 'x'), descriptors(4, 1.f)) == -ENAMETOOLONG);
+		CHECK(database.append(std::string(dms::DriverRecord::MAX_NAME_LENGTH, 'x'), descriptors(4, 1.f)) == 3);
+		CHECK(database.snapshot()->numDrivers() == 4);
+		CHECK(database.snapshot()->findDriver(std::string(dms::DriverRecord::MAX_NAME_LENGTH, 'x')) == 3);
+		CHECK(database.snapshot()->findDriver("5") == -1);
+	}
+
+	void testMovesCorruptStoreAside() {
+		const std::string dir = makeTempDir();
+		{
+			dms::DriverDatabase database(dir + "drivers.emb");
+			CHECK(!database.snapshot());
+			CHECK(database.append("1", descriptors(4, 1.f)) == 0);
+		}
+		{
+			std::fstream fs(dir + "drivers.emb", std::ios::binary | std::ios::in | std::ios::out);
+			fs.seekp(sizeof(dms::EmbeddingStoreHeader) + 10);
+			fs.put('\x7f');
+		}
+
+		dms::DriverDatabase database(dir + "drivers.emb");
+		CHECK(!database.snapshot());
+		CHECK(exists(dir + "drivers.emb.corrupt"));
+		CHECK(database.append("2", descriptors(4, 2.f)) == 0);
+		CHECK(database.snapshot()->numDrivers() == 1);
+	}
+}
+
+int main() {
+	testImportsLegacyDrivers();
+	testNamesAreUnique();
+	testMovesCorruptStoreAside();
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+#include <vector>
+
+#include "alloc_counter.hpp"
+#include "check.hpp"
+#include "face_parser.hpp"
+#include "synthetic_face.hpp"
+
+namespace {
+	constexpr size_t WIDTH = 640, HEIGHT = 480, FRAMES = 1000;
+
+	// Heap allocations of `FRAMES` estimateGaze calls after a warm-up frame
+	size_t allocationsPerRun(const dms::GazeMode mode, const std::vector<DMSLandmarks>& frames) {
+		dms::GazeEstimator estimator(mode);
+		estimator.estimateGaze(frames[0], WIDTH, HEIGHT);
+
+		const size_t before = alloc_counter::count();
+		for (size_t i = 1; i < frames.size(); i++)
+			estimator.estimateGaze(frames[i], WIDTH, HEIGHT);
+		return alloc_counter::count() - before;
+	}
+}
+
+int main() {
+	const std::vector<DMSLandmarks> frames = syntheticFaceFrames(FRAMES + 1, WIDTH, HEIGHT);
+
+	// The warm head pose is refined on the stack.
+	CHECK(allocationsPerRun(dms::GazeMode::ANALYTIC, frames) == 0);
+
+	// estimateAffine3D still allocates; reported, not enforced.
+	std::cout << "affine: " << static_cast<double>(allocationsPerRun(dms::GazeMode::AFFINE, frames)) / FRAMES
+	          << " allocations per frame" << std::endl;
+
+	dms::EyeClosednessCalculator ear;
+	const size_t before = alloc_counter::count();
+	for (const DMSLandmarks& dmsl : frames)
+		ear.calculateEyeClosedness(dmsl);
+	CHECK(alloc_counter::count() == before);
+	return 0;
+}
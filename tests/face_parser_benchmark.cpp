@@ -0,0 +1,36 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "alloc_counter.hpp"
+#include "face_parser.hpp"
+#include "synthetic_face.hpp"
+
+// Per-frame cost of GazeEstimator on synthetic landmarks, in each mode.
+int main(int argc, char** argv) {
+	constexpr size_t WIDTH = 640, HEIGHT = 480;
+	const size_t frames_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	const std::vector<DMSLandmarks> frames = syntheticFaceFrames(frames_count, WIDTH, HEIGHT);
+
+	const std::pair<const char*, dms::GazeMode> modes[] = {
+		{ "affine", dms::GazeMode::AFFINE },
+		{ "analytic", dms::GazeMode::ANALYTIC }
+	};
+	std::cout << "mode        us/frame  allocs/frame" << std::endl;
+	for (const auto& mode : modes) {
+		dms::GazeEstimator estimator(mode.second);
+		volatile double sink = 0;
+		const size_t allocations = alloc_counter::count();
+		const auto start = std::chrono::steady_clock::now();
+		for (const DMSLandmarks& dmsl : frames)
+			sink = sink + estimator.estimateGaze(dmsl, WIDTH, HEIGHT).yaw;
+		const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::cout << std::left << std::setw(10) << mode.first << std::right << std::fixed << std::setprecision(2)
+		          << std::setw(10) << elapsed.count() / frames.size()
+		          << std::setw(14) << static_cast<double>(alloc_counter::count() - allocations) / frames.size() << std::endl;
+	}
+	return 0;
+}
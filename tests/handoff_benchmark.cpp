@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "common.hpp"
+
+// Cost of handing the inferrer's result to the capture loop through the
+// mutex-guarded dms::Pack it used to use and through dms::TripleBuffer.
+// The writer publishes at camera rates while the reader polls as fast
+// as it can, which is the worst case for the reader.
+namespace {
+	// Same shape as DMSResult in watchout/main.cpp
+	struct Result {
+		dms::GazeAngle gaze_angle;
+		dms::EyeAspectRatio eye_aspect_ratio;
+		size_t frame_seq;
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	// Power-of-two histogram of call latencies in nanoseconds
+	struct Latencies {
+		std::array<uint64_t, 40> buckets{};
+		uint64_t count = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+
+		void add(const Clock::duration latency) {
+			const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+			buckets[ns ? std::min<size_t>(64 - __builtin_clzll(ns), buckets.size() - 1) : 0]++;
+			count++;
+			total_ns += ns;
+			max_ns = std::max(max_ns, ns);
+		}
+
+		// Upper bound of the bucket holding the `p`th percentile
+		uint64_t percentileNs(const double p) const {
+			const uint64_t rank = static_cast<uint64_t>(p / 100 * count);
+			uint64_t seen = 0;
+			for (size_t i = 0; i < buckets.size(); i++) {
+				seen += buckets[i];
+				if (seen > rank) return std::min((uint64_t(1) << i) - 1, max_ns);
+			}
+			return max_ns;
+		}
+	};
+
+	struct Run {
+		Latencies writer;
+		Latencies reader;
+	};
+
+	template <typename Write, typename Read>
+	Run run(const int rate_hz, const std::chrono::milliseconds duration, Write write, Read read) {
+		Run result;
+		std::atomic<bool> done{false};
+
+		std::thread writer([&] {
+			const Clock::duration period = std::chrono::microseconds(1000000 / rate_hz);
+			Clock::time_point next = Clock::now();
+			const Clock::time_point end = next + duration;
+			for (size_t seq = 1; next < end; seq++) {
+				Result value{ { 1.0 * seq, 2.0 }, { 0.3 }, seq };
+				const Clock::time_point start = Clock::now();
+				write(value);
+				result.writer.add(Clock::now() - start);
+				next += period;
+				std::this_thread::sleep_until(next);
+			}
+			done.store(true);
+		});
+
+		while (!done.load(std::memory_order_relaxed)) {
+			const Clock::time_point start = Clock::now();
+			read();
+			result.reader.add(Clock::now() - start);
+		}
+		writer.join();
+		return result;
+	}
+
+	void print(const char* handoff, const int rate_hz, const char* side, const Latencies& latencies) {
+		std::cout << std::left << std::setw(14) << handoff << std::right << std::setw(5) << rate_hz
+		          << std::left << "  " << std::setw(8) << side << std::right
+		          << std::setw(12) << latencies.count
+		          << std::setw(10) << (latencies.count ? latencies.total_ns / latencies.count : 0)
+		          << std::setw(10) << latencies.percentileNs(99)
+		          << std::setw(10) << latencies.percentileNs(99.99)
+		          << std::setw(12) << latencies.max_ns << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	const std::chrono::milliseconds duration(argc > 1 ? std::strtol(argv[1], nullptr, 10) : 2000);
+
+	std::cout << "handoff        Hz  side           calls   mean ns    p99 ns  p99.99 ns      max ns" << std::endl;
+	for (const int rate_hz : { 30, 60, 120 }) {
+		dms::Pack<Result> pack;
+		const Run mutex_run = run(rate_hz, duration,
+			[&](const Result& value) {
+				std::unique_lock<std::mutex> ul(pack.m);
+				pack() = value;
+			},
+			[&] {
+				std::unique_lock<std::mutex> ul(pack.m);
+				return pack();
+			});
+		print("mutex", rate_hz, "writer", mutex_run.writer);
+		print("mutex", rate_hz, "reader", mutex_run.reader);
+
+		dms::TripleBuffer<Result> triple_buffer;
+		const Run triple_buffer_run = run(rate_hz, duration,
+			[&](const Result& value) { triple_buffer.write(value); },
+			[&] { return triple_buffer.read(); });
+		print("triple buffer", rate_hz, "writer", triple_buffer_run.writer);
+		print("triple buffer", rate_hz, "reader", triple_buffer_run.reader);
+	}
+	return 0;
+}
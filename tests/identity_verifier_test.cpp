@@ -0,0 +1,93 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "identity_verifier.hpp"
+
+using dms::IdentityStatus;
+
+namespace {
+	using Descriptor = dlib::matrix<float, 0, 1>;
+
+	// A face: a random point, and samples of it a little apart
+	struct Face {
+		Descriptor center;
+
+		explicit Face(std::mt19937& rng) {
+			std::normal_distribution<float> distribution(0.f, 0.1f);
+			center.set_size(dms::EmbeddingStore::DIM);
+			for (long k = 0; k < center.size(); k++)
+				center(k) = distribution(rng);
+		}
+
+		Descriptor sample(std::mt19937& rng) const {
+			std::normal_distribution<float> noise(0.f, 0.005f);
+			Descriptor descriptor = center;
+			for (long k = 0; k < descriptor.size(); k++)
+				descriptor(k) += noise(rng);
+			return descriptor;
+		}
+
+		std::vector<Descriptor> samples(const size_t count, std::mt19937& rng) const {
+			std::vector<Descriptor> descriptors;
+			for (size_t i = 0; i < count; i++)
+				descriptors.push_back(sample(rng));
+			return descriptors;
+		}
+	};
+
+	std::string makeTempDir() {
+		char dir[] = "/tmp/identity_verifier_test.XXXXXX";
+		CHECK(mkdtemp(dir) != nullptr);
+		return std::string(dir) + "/";
+	}
+
+	void testDriverSwap() {
+		std::mt19937 rng(7);
+		const Face first(rng), second(rng), stranger(rng);
+		dms::DriverDatabase database(makeTempDir() + "drivers.emb");
+		const int first_id = database.append("", first.samples(5, rng));
+		const int second_id = database.append("", second.samples(5, rng));
+		CHECK(first_id == 0 && second_id == 1);
+		const std::shared_ptr<const dms::EmbeddingStore> drivers = database.snapshot();
+
+		dms::IdentityVerifier verifier(first_id);
+		CHECK(verifier.verify(first.sample(rng), drivers.get()) == IdentityStatus::VERIFIED);
+		CHECK(verifier.verify(first.sample(rng), drivers.get()) == IdentityStatus::VERIFIED);
+		CHECK(verifier.driverId() == first_id);
+
+		// The drivers swap at a stop.
+		CHECK(verifier.verify(second.sample(rng), drivers.get()) == IdentityStatus::CHANGED);
+		CHECK(verifier.driverId() == second_id);
+		CHECK(verifier.verify(second.sample(rng), drivers.get()) == IdentityStatus::VERIFIED);
+
+		// And back again
+		CHECK(verifier.verify(first.sample(rng), drivers.get()) == IdentityStatus::CHANGED);
+		CHECK(verifier.driverId() == first_id);
+
+		// Nobody registered keeps the last known driver.
+		CHECK(verifier.verify(stranger.sample(rng), drivers.get()) == IdentityStatus::UNKNOWN);
+		CHECK(verifier.driverId() == first_id);
+	}
+
+	void testNobodyAuthenticated() {
+		std::mt19937 rng(8);
+		const Face face(rng);
+		dms::IdentityVerifier verifier;
+		CHECK(verifier.verify(face.sample(rng), nullptr) == IdentityStatus::UNKNOWN);
+
+		dms::DriverDatabase database(makeTempDir() + "drivers.emb");
+		CHECK(database.append("", face.samples(5, rng)) == 0);
+		CHECK(verifier.verify(face.sample(rng), database.snapshot().get()) == IdentityStatus::CHANGED);
+		CHECK(verifier.driverId() == 0);
+	}
+}
+
+int main() {
+	testDriverSwap();
+	testNobodyAuthenticated();
+	return 0;
+}
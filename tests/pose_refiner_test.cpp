@@ -0,0 +1,115 @@
+#include <array>
+#include <cmath>
+
+#include "alloc_counter.hpp"
+#include "check.hpp"
+#include "pose_refiner.hpp"
+
+namespace {
+	// GazeEstimator's face model
+	const std::array<dms::Vec3, 6> MODEL_POINTS = { {
+		{ 0.0, 0.0, 0.0 }, { 0, -63.6, -12.5 }, { -43.3, 32.7, -26 },
+		{ 43.3, 32.7, -26 }, { -28.9, -28.9, -24.1 }, { 28.9, -28.9, -24.1 }
+	} };
+	constexpr double FOCAL = 640, CX = 320, CY = 240;
+
+	std::array<dms::Vec2, 6> projectModel(const dms::Vec3& rvec, const dms::Vec3& tvec) {
+		const dms::Mat3 R = dms::rodrigues(rvec);
+		std::array<dms::Vec2, 6> image;
+		for (size_t i = 0; i < MODEL_POINTS.size(); i++)
+			image[i] = dms::project(MODEL_POINTS[i], R, tvec, FOCAL, CX, CY);
+		return image;
+	}
+
+	bool near(const double a, const double b, const double tolerance) {
+		return std::fabs(a - b) <= tolerance;
+	}
+
+	void testRodrigues() {
+		const dms::Mat3 R = dms::rodrigues({ 0, 0, M_PI / 2 });
+		const dms::Mat3 expected = { 0, -1, 0, 1, 0, 0, 0, 0, 1 };
+		for (size_t i = 0; i < 9; i++)
+			CHECK(near(R[i], expected[i], 1e-12));
+
+		const dms::Mat3 identity = dms::rodrigues({ 0, 0, 0 });
+		for (size_t i = 0; i < 9; i++)
+			CHECK(identity[i] == (i % 4 == 0 ? 1 : 0));
+
+		// Orthonormal for an arbitrary axis
+		const dms::Mat3 Q = dms::rodrigues({ 0.3, -0.7, 0.2 });
+		for (size_t r = 0; r < 3; r++)
+			for (size_t c = 0; c < 3; c++) {
+				double dot = 0;
+				for (size_t k = 0; k < 3; k++)
+					dot += Q[3 * r + k] * Q[3 * c + k];
+				CHECK(near(dot, r == c ? 1 : 0, 1e-12));
+			}
+	}
+
+	void testRefinesWarmStart() {
+		const dms::Vec3 rvec_true = { 0.1, -0.25, 0.05 };
+		const dms::Vec3 tvec_true = { 15, -10, 600 };
+		const std::array<dms::Vec2, 6> image = projectModel(rvec_true, tvec_true);
+
+		// The previous frame's pose, a few degrees and millimeters off
+		dms::Vec3 rvec = { 0.14, -0.2, 0.02 };
+		dms::Vec3 tvec = { 10, -5, 620 };
+		const double error = dms::refinePose(MODEL_POINTS, image, FOCAL, CX, CY, rvec, tvec, 5, 1e-9);
+		CHECK(error < 0.01);
+		for (size_t i = 0; i < 3; i++) {
+			CHECK(near(rvec[i], rvec_true[i], 1e-4));
+			CHECK(near(tvec[i], tvec_true[i], 0.1));
+		}
+	}
+
+	void testBadWarmStartFallsBackCold() {
+		const dms::Vec3 rvec_true = { 0.1, -0.25, 0.05 };
+		const dms::Vec3 tvec_true = { 15, -10, 600 };
+		const std::array<dms::Vec2, 6> image = projectModel(rvec_true, tvec_true);
+
+		// The last cold solve fit well, then the face jumped: a pose turned
+		// away and far off is no start for five LM steps.
+		dms::WarmStartGate gate;
+		gate.coldSolved(0.5);
+		dms::Vec3 rvec = { 0.1, 2.5, 0.05 };
+		dms::Vec3 tvec = { 300, 200, 1500 };
+		const double error = dms::refinePose(MODEL_POINTS, image, FOCAL, CX, CY, rvec, tvec, 5, 1e-9);
+		CHECK(!gate.accepts(error));
+
+		// A warm start that gets a little worse every frame is cut off once
+		// it leaves the bound of the last cold solve, however slowly it got
+		// there.
+		double warm_error = 0.5;
+		int accepted = 0;
+		while (gate.accepts(warm_error *= 1.9))
+			accepted++;
+		CHECK(accepted == 2); // 0.95 and 1.805 px, under the floor
+		CHECK(gate.accepts(dms::WarmStartGate::ERROR_FLOOR));
+
+		gate.coldSolved(3);
+		CHECK(gate.accepts(6));
+		CHECK(!gate.accepts(6.1));
+	}
+
+	void testTracksWithoutAllocating() {
+		dms::Vec3 rvec = { 0, 0, 0 };
+		dms::Vec3 tvec = { 0, 0, 600 };
+		const size_t before = alloc_counter::count();
+		for (int frame = 0; frame < 1000; frame++) {
+			const double t = frame / 30.;
+			const dms::Vec3 rvec_true = { 0.2 * std::sin(t), 0.3 * std::sin(0.7 * t), 0.05 * std::cos(t) };
+			const dms::Vec3 tvec_true = { 20 * std::sin(0.5 * t), 0, 600 + 30 * std::cos(0.3 * t) };
+			const std::array<dms::Vec2, 6> image = projectModel(rvec_true, tvec_true);
+			CHECK(dms::refinePose(MODEL_POINTS, image, FOCAL, CX, CY, rvec, tvec, 5, 1e-9) < 0.05);
+		}
+		CHECK(alloc_counter::count() == before);
+	}
+}
+
+int main() {
+	testRodrigues();
+	testRefinesWarmStart();
+	testBadWarmStartFallsBackCold();
+	testTracksWithoutAllocating();
+	return 0;
+}
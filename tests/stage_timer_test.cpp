@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "check.hpp"
+#include "stage_timer.hpp"
+
+using dms::LatencyHistogram;
+
+namespace {
+	bool within(const double value, const double expected, const double relative) {
+		return std::fabs(value - expected) <= relative * expected;
+	}
+
+	void testBuckets() {
+		// Exact below SUB_BUCKETS
+		for (uint64_t us = 0; us < LatencyHistogram::SUB_BUCKETS; us++) {
+			CHECK(LatencyHistogram::bucketOf(us) == us);
+			CHECK(LatencyHistogram::valueOf(LatencyHistogram::bucketOf(us)) == us);
+		}
+
+		// Then within 1 / (SUB_BUCKETS / 2) of the value, in order
+		size_t previous = 0;
+		for (uint64_t us = 1; us < LatencyHistogram::MAX_US; us += us / 7 + 1) {
+			const size_t bucket = LatencyHistogram::bucketOf(us);
+			CHECK(bucket >= previous);
+			CHECK(bucket < LatencyHistogram::BUCKETS);
+			CHECK(within(LatencyHistogram::valueOf(bucket), static_cast<double>(us), 1. / 32));
+			previous = bucket;
+		}
+
+		// Larger values share the last bucket
+		CHECK(LatencyHistogram::bucketOf(LatencyHistogram::MAX_US - 1) == LatencyHistogram::BUCKETS - 1);
+		CHECK(LatencyHistogram::bucketOf(LatencyHistogram::MAX_US * 4) == LatencyHistogram::BUCKETS - 1);
+	}
+
+	void testPercentiles() {
+		LatencyHistogram histogram;
+		CHECK(histogram.count() == 0);
+		CHECK(histogram.percentileUs(50) == 0);
+
+		for (uint64_t us = 1; us <= 1000; us++)
+			histogram.add(us);
+		CHECK(histogram.count() == 1000);
+		CHECK(histogram.maxUs() == 1000);
+		CHECK(within(histogram.percentileUs(50), 500, 1. / 32));
+		CHECK(within(histogram.percentileUs(90), 900, 1. / 32));
+		CHECK(within(histogram.percentileUs(99), 990, 1. / 32));
+		CHECK(histogram.percentileUs(100) == 1000);
+		CHECK(histogram.percentileUs(0) == 1);
+
+		// A single outlier only moves the tail
+		LatencyHistogram other;
+		for (int i = 0; i < 1000; i++)
+			other.add(20);
+		other.add(5000000);
+		histogram.merge(other);
+		CHECK(histogram.count() == 2001);
+		CHECK(histogram.maxUs() == 5000000);
+		CHECK(histogram.percentileUs(50) == 20);
+		CHECK(histogram.percentileUs(100) == 5000000);
+	}
+
+	void testReportKeepsFormat() {
+		dms::StageTimers::record(dms::Stage::GAZE, std::chrono::microseconds(1500));
+		dms::StageTimers::record(dms::Stage::GAZE, std::chrono::microseconds(2500));
+
+		std::ostringstream os;
+		os.precision(4);
+		const std::ios_base::fmtflags flags = os.flags();
+		dms::StageTimers::report(os);
+		CHECK(os.flags() == flags);
+		CHECK(os.precision() == 4);
+
+		const std::string report = os.str();
+		CHECK(report.find("gaze") != std::string::npos);
+		CHECK(report.find("display") == std::string::npos); // Never recorded
+	}
+}
+
+int main() {
+	testBuckets();
+	testPercentiles();
+	testReportKeepsFormat();
+	return 0;
+}
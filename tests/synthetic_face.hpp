@@ -0,0 +1,43 @@
+#ifndef SYNTHETIC_FACE_HPP
+#define SYNTHETIC_FACE_HPP
+
+#include <cmath>
+#include <vector>
+
+#include "pose_refiner.hpp"
+#include "run_graph_main.h"
+
+// Landmarks of GazeEstimator's face model under a slowly moving head
+// pose, as the graph would report them for a `width` x `height` frame.
+inline std::vector<DMSLandmarks> syntheticFaceFrames(const size_t count, const size_t width, const size_t height) {
+	struct Point {
+		size_t landmark;
+		dms::Vec3 model;
+	};
+	const Point points[] = {
+		{ 0, { 0.0, 0.0, 0.0 } },           // Nose tip
+		{ 1, { 0, -63.6, -12.5 } },         // Chin
+		{ 7, { -43.3, 32.7, -26 } },        // Left eye, left corner
+		{ 13, { 43.3, 32.7, -26 } },        // Right eye, right corner
+		{ 2, { -28.9, -28.9, -24.1 } },     // Left mouth corner
+		{ 3, { 28.9, -28.9, -24.1 } },      // Right mouth corner
+		{ LEFT_PUPIL_CENTER, { -29.05, 32.7, -27.5 } },
+		{ RIGHT_PUPIL_CENTER, { 29.05, 32.7, -27.5 } }
+	};
+
+	std::vector<DMSLandmarks> frames(count);
+	for (size_t frame = 0; frame < count; frame++) {
+		const double t = frame / 30.;
+		// Facing the camera: the model's y axis points up, the image's down.
+		const dms::Vec3 rvec = { M_PI + 0.15 * std::sin(t), 0.25 * std::sin(0.7 * t), 0.05 * std::cos(t) };
+		const dms::Vec3 tvec = { 20 * std::sin(0.5 * t), 0, 600 + 30 * std::cos(0.3 * t) };
+		const dms::Mat3 R = dms::rodrigues(rvec);
+		for (const Point& point : points) {
+			const dms::Vec2 p = dms::project(point.model, R, tvec, static_cast<double>(width), width / 2, height / 2);
+			frames[frame].landmarks[point.landmark] = cv::Point3d(p[0] / width, p[1] / height, 0);
+		}
+	}
+	return frames;
+}
+
+#endif
@@ -1,143 +1,575 @@
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
 #include <iostream>
 #include <mutex>
 #include <random>
 #include <string>
 #include <thread>
 #include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
 
 #include <QApplication>
 #include <opencv2/opencv.hpp>
 
 #include "run_graph_main.h"
+#include "asset_bundle.hpp"
 #include "face_parser.hpp"
+#include "camera.hpp"
 #include "face_recognizer.hpp"
 #include "mainwindow.h"
 #include "common.hpp"
+#include "stage_timer.hpp"
 
 struct DMSResult {
 	dms::GazeAngle gaze_angle;
 	dms::EyeAspectRatio eye_aspect_ratio;
+	size_t frame_seq; // `seq` of the landmarks the result was computed from
+};
+
+// Landmarks of one graph result, handed from the capture loop to the inferrer
+struct DMSLandmarkFrame {
+	size_t seq; // Counts every graph result the capture loop picked up, with or without a face
+	size_t timestamp_us;
+	int frame_width;
+	int frame_height;
+	DMSLandmarks landmarks;
 };
 
-// hard code the graph content on `run_graph_main.cc` later
-constexpr char graph_config_file[] = "/home/jetson/ssd/watchout/dependencies/mediapipe/mediapipe/graphs/iris_tracking/iris_tracking_gpu.pbtxt";
+// Command line switches of the monitoring loop
+constexpr char option_headless[] = "--headless";   // No display attached: skip rendering, readback and imshow
+constexpr char option_cpu[] = "--cpu";             // Run the landmark graph on the CPU backend
+constexpr char option_dms_graph[] = "--dms-graph"; // Run the trimmed GPU graph that computes only the DMS landmarks (implies --headless)
+constexpr char option_cpu_cores[] = "--cpu-cores="; // Comma separated cores to pin the graph threads to, e.g. --cpu-cores=2,3
+constexpr char option_replay[] = "--replay=";       // Benchmark the pipeline on a recorded video instead of the camera
+constexpr char option_gaze[] = "--gaze=";           // Gaze back-projection: "affine" (default) or "analytic"
+constexpr char option_gaze_compare[] = "--gaze-compare"; // With --replay, also run the other gaze mode and report the difference
+constexpr char option_recognizer[] = "--recognizer=";  // Embed faces with this TFLite export of the recognizer (fp16 or int8)
+constexpr char option_recognizer_parity[] = "--recognizer-parity="; // With --recognizer, compare it to the dlib recognizer on a recorded video
+constexpr char option_profile[] = "--profile=";     // Profile the landmark graph into this directory (trace files and per-node latency summary)
+
+bool hasOption(int argc, char* argv[], const std::string& option) {
+	for (int i = 1; i < argc; ++i) {
+		if (option == argv[i])
+			return true;
+	}
+	return false;
+}
+
+// Returns the value of a `--name=value` option, or an empty string.
+std::string getOption(int argc, char* argv[], const std::string& option) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg.compare(0, option.size(), option) == 0)
+			return arg.substr(option.size());
+	}
+	return "";
+}
+
+// Cores that can be pinned to: the online ones, within what a cpu_set_t holds
+long pinnableCoreCount() {
+	const long online = sysconf(_SC_NPROCESSORS_ONLN);
+	return online > 0 ? std::min<long>(online, CPU_SETSIZE) : CPU_SETSIZE;
+}
+
+// Parses the comma separated core numbers of --cpu-cores. Returns false,
+// leaving `parsed` unspecified, if any entry is not a pinnable core.
+bool parseCores(const std::string& cores, std::vector<int>& parsed) {
+	parsed.clear();
+	if (cores.empty())
+		return true;
+	const long num_cores = pinnableCoreCount();
+	for (size_t begin = 0;;) {
+		const size_t end = cores.find(',', begin);
+		const std::string core = cores.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+		if (core.empty() || !std::isdigit(static_cast<unsigned char>(core[0])))
+			return false;
+		char* core_end = nullptr;
+		errno = 0;
+		const long value = std::strtol(core.c_str(), &core_end, 10);
+		if (*core_end != '\0' || errno == ERANGE || value < 0 || value >= num_cores)
+			return false;
+		parsed.push_back(static_cast<int>(value));
+		if (end == std::string::npos)
+			return true;
+		begin = end + 1;
+	}
+}
+
+// The trimmed graph renders nothing, so it always runs headless.
+bool isHeadless(int argc, char* argv[]) {
+	return hasOption(argc, argv, option_headless) || hasOption(argc, argv, option_dms_graph);
+}
+
+dms::GazeMode getGazeMode(int argc, char* argv[]) {
+	return getOption(argc, argv, option_gaze) == "analytic" ? dms::GazeMode::ANALYTIC : dms::GazeMode::AFFINE;
+}
+
+// Initializes the landmark graph according to the command line switches.
+// The graphs are compiled into the library and the models are read from
+// the asset bundle, so nothing depends on the working directory.
+bool initLandmarkGraph(MPPGraphRunnerWrapper& dms_runner, int argc, char* argv[], bool async) {
+	const bool headless = isHeadless(argc, argv);
+	// There is only a rendering CPU graph.
+	if (hasOption(argc, argv, option_cpu) && headless) {
+		std::cerr << option_cpu << " cannot be combined with " << option_headless << " or " << option_dms_graph
+		          << ", there is no headless CPU graph." << std::endl;
+		return false;
+	}
+
+	MPPGraphOptions graph_options;
+	graph_options.async = async;
+	graph_options.headless = headless;
+	if (!parseCores(getOption(argc, argv, option_cpu_cores), graph_options.cpu_cores)) {
+		std::cerr << "Usage: " << option_cpu_cores << "<core>[,<core>...] with cores from 0 to "
+		          << pinnableCoreCount() - 1 << ", e.g. " << option_cpu_cores << "2,3" << std::endl;
+		return false;
+	}
+	graph_options.profile_path = getOption(argc, argv, option_profile);
+	if (std::shared_ptr<const dms::AssetBundle> assets = dms::AssetBundle::shared()) {
+		graph_options.resource_provider = [assets](const std::string& path, std::string& contents) {
+			const std::string_view asset = assets->find(path.substr(path.rfind('/') + 1));
+			if (asset.empty()) return false;
+			contents.assign(asset.data(), asset.size());
+			return true;
+		};
+	}
+	if (hasOption(argc, argv, option_cpu)) {
+		graph_options.backend = MPPGraphBackend::CPU;
+		return dms_runner.initMPPGraph(MPPGraphConfig::IRIS_TRACKING_CPU, graph_options);
+	}
+	if (hasOption(argc, argv, option_dms_graph))
+		return dms_runner.initMPPGraph(MPPGraphConfig::DMS_LANDMARKS_GPU, graph_options);
+	return dms_runner.initMPPGraph(headless ? MPPGraphConfig::IRIS_TRACKING_GPU_HEADLESS : MPPGraphConfig::IRIS_TRACKING_GPU, graph_options);
+}
+
+// Timestamps of camera frames fed to the landmark graph. Authentication and
+// monitoring share the graph, so they must share the clock as well.
+size_t cameraTimestampUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs one camera frame through the graph so that the delegates and GL
+// programs are set up before anybody waits on it.
+void warmUpLandmarkGraph(MPPGraphRunnerWrapper& dms_runner, dms::CameraSession& camera) {
+	cv::Mat frame, output_frame;
+	DMSLandmarks landmarks;
+	bool landmark_presence;
+	size_t frame_seq = 0;
+	if (camera.read(frame, frame_seq))
+		dms_runner.processFrame(frame, cameraTimestampUs(), output_frame, landmarks, landmark_presence);
+}
 
-int authenticateDriver(int argc, char* argv[]) {
+int authenticateDriver(int argc, char* argv[], dms::CameraSession& camera, MPPGraphRunnerWrapper* dms_runner,
+	std::string& driver_name) {
 	QApplication auth_app(argc, argv);
 
 	MainWindow auth_window;
+	auth_window.setCamera(&camera);
+	// Locate the face with the landmark graph rather than the HOG scan.
+	auth_window.setLandmarkGraph(dms_runner);
 	auth_window.setWindowState(Qt::WindowFullScreen);
 	auth_window.show();
 
-	return auth_app.exec();
+	const int ret = auth_app.exec();
+	driver_name = auth_window.driverName().toStdString();
+	return ret;
 }
 
+/*
+Computes gaze and EAR exactly once for every landmark set the capture
+loop hands over, as soon as it arrives. Returns when the channel is
+closed.
+*/
 void inferDriverStatus(
-	dms::Pack<DMSLandmarks>& dmsl,
-	dms::Pack<DMSResult>& dmsr,
-	volatile bool& run) {
-	std::this_thread::sleep_for(std::chrono::seconds(5));
-
-	DMSLandmarks landmarks;
+	dms::Channel<DMSLandmarkFrame>& dmsl,
+	dms::TripleBuffer<DMSResult>& dmsr,
+	dms::GazeMode gaze_mode) {
+	DMSLandmarkFrame frame;
 	dms::GazeAngle gaze_angle;
 	dms::EyeAspectRatio eye_aspect_ratio;
-	dms::GazeEstimator gaze_estimator;
+	dms::GazeEstimator gaze_estimator(gaze_mode);
 	dms::EyeClosednessCalculator eye_closedness_calculator;
 	dms::Rate rate(30);
-	while (run) {
+	size_t last_seq = 0;
+	while (dmsl.pop(frame)) {
+		// A gap means the face was lost (or frames were dropped) in
+		// between, so the previous head pose is no good as a start.
+		if (frame.seq != last_seq + 1)
+			gaze_estimator.reset();
+		last_seq = frame.seq;
+
 		{
-			std::unique_lock<std::mutex> ul(dmsl.m);
-			landmarks = dmsl();
+			dms::ScopedStageTimer timer(dms::Stage::GAZE);
+			gaze_angle = gaze_estimator.estimateGaze(frame.landmarks, frame.frame_width, frame.frame_height);
 		}
-
-		gaze_angle = gaze_estimator.estimateGaze(landmarks, 640, 480);
-		eye_aspect_ratio = eye_closedness_calculator.calculateEyeClosedness(landmarks);
 		{
-			std::unique_lock<std::mutex> ul(dmsr.m);
-			dmsr().gaze_angle = gaze_angle;
-			dmsr().eye_aspect_ratio = eye_aspect_ratio;
+			dms::ScopedStageTimer timer(dms::Stage::EAR);
+			eye_aspect_ratio = eye_closedness_calculator.calculateEyeClosedness(frame.landmarks);
 		}
+		dmsr.writeBuffer().gaze_angle = gaze_angle;
+		dmsr.writeBuffer().eye_aspect_ratio = eye_aspect_ratio;
+		dmsr.writeBuffer().frame_seq = frame.seq;
+		dmsr.publish();
 
 		std::cout << __func__ << " " << rate.get() << " FPS" << std::endl;
-		rate.sleep();
 	}
 }
 
-int monitorDriver(int argc, char* argv[]) {
-	MPPGraphRunnerWrapper dms_runner;
-	dms_runner.initMPPGraph(graph_config_file);
+std::string identityCaption(const dms::DriverIdentityTracker::Status identity, const std::string& driver_name) {
+	switch (identity) {
+	case dms::DriverIdentityTracker::Status::VERIFIED: return driver_name;
+	case dms::DriverIdentityTracker::Status::CHANGED: return driver_name + " (changed)";
+	case dms::DriverIdentityTracker::Status::UNKNOWN: return "unknown";
+	default: return "checking";
+	}
+}
 
-	dms::Pack<DMSLandmarks> dms_landmarks;
-	dms::Pack<DMSResult> dms_result;
-	volatile bool run_inferrer = true;
-	std::thread th_inferrer(inferDriverStatus, std::ref(dms_landmarks), std::ref(dms_result), std::ref(run_inferrer));
+// Set by SIGINT/SIGTERM during monitoring, which then ends cleanly and
+// prints the stage report. A headless run has no window to press a key in.
+std::atomic<bool> monitoring_stop_requested{false};
+
+int monitorDriver(int argc, char* argv[], dms::CameraSession& camera, MPPGraphRunnerWrapper& dms_runner,
+	const std::string& driver_name) {
+	const bool headless = isHeadless(argc, argv);
+	monitoring_stop_requested = false;
+	const auto stop_monitoring = [](int) { monitoring_stop_requested.store(true, std::memory_order_relaxed); };
+	std::signal(SIGINT, stop_monitoring);
+	std::signal(SIGTERM, stop_monitoring);
+
+	dms::Channel<DMSLandmarkFrame> dms_landmarks;
+	dms::TripleBuffer<DMSResult> dms_result;
+	std::thread th_inferrer(inferDriverStatus, std::ref(dms_landmarks), std::ref(dms_result), getGazeMode(argc, argv));
 
-	cv::VideoCapture capture(0);
-	// capture.set(cv::CAP_PROP_FRAME_WIDTH, 240);
-	// capture.set(cv::CAP_PROP_FRAME_HEIGHT, 240);
 	cv::Mat input_frame;
 	cv::Mat output_frame;
-	DMSLandmarks landmarks;
+	MPPGraphResult graph_result;
+	DMSLandmarkFrame landmark_frame;
 	DMSResult result;
 
+	// Re-verifies the driver when the face track is lost or once in a
+	// while. Frames stay here until the graph's result for them is in, so
+	// the face chip is cut from the frame the landmarks belong to. The
+	// graph's FlowLimiter drops frames it has no room for, and their
+	// results never come, so the oldest frames are dropped here as well
+	// rather than piling up.
+	dms::DriverIdentityTracker identity_tracker(driver_name);
+	dms::DriverIdentityTracker::Status identity = dms::DriverIdentityTracker::Status::PENDING;
+	constexpr size_t max_pending_frames = 8;
+	std::deque<std::pair<size_t, cv::Mat>> pending_frames;
+
 	// cv::namedWindow("Result", cv::WINDOW_NORMAL);
 	// cv::setWindowProperty("Result", cv::WND_PROP_FULLSCREEN, cv::WINDOW_FULLSCREEN);
 
 	bool landmark_exists = false;
 	bool run_landmarker = true;
+	size_t frame_seq = 0;
+	size_t camera_seq = 0;
 	dms::Rate rate(100);
-	while (run_landmarker) {
-		capture.read(input_frame);
-		cv::cvtColor(input_frame, input_frame, cv::COLOR_BGR2RGBA);
-		size_t frame_timestamp = static_cast<double>(cv::getTickCount()) / static_cast<double>(cv::getTickFrequency()) * 1e6;
-		dms_runner.processFrame(input_frame, frame_timestamp, output_frame, landmarks, landmark_exists);
+	while (run_landmarker && !monitoring_stop_requested.load(std::memory_order_relaxed)) {
+		if (!camera.read(input_frame, camera_seq))
+			break;
+		size_t frame_timestamp = cameraTimestampUs();
+		{
+			dms::ScopedStageTimer timer(dms::Stage::SUBMIT);
+			dms_runner.submitFrame(input_frame, frame_timestamp);
+		}
+		if (pending_frames.size() == max_pending_frames)
+			pending_frames.pop_front();
+		pending_frames.emplace_back(frame_timestamp, input_frame);
 
-		if (landmark_exists) {
-			std::unique_lock<std::mutex> ul(dms_landmarks.m);
-			dms_landmarks() = landmarks;
+		// The graph keeps working while the next frame is captured. Only the
+		// newest finished result is shown and handed to the inferrer, but
+		// every popped result counts towards `frame_seq`, so the inferrer
+		// sees the skipped ones as a gap.
+		bool has_result = false;
+		while (dms_runner.pollResult(graph_result)) {
+			has_result = true;
+			++frame_seq;
 		}
 
-		if (cv::waitKey(10) >= 0) {
+		// Only a window can take a key press; without one this would just
+		// hold every frame up by 10 ms.
+		if (!headless && cv::waitKey(10) >= 0)
 			run_landmarker = false;
-			run_inferrer = false;
-		}
+		dms::StageTimers::reportIfRequested(std::cout);
 
-		{
-			std::unique_lock<std::mutex> ul(dms_result.m);
-			result = dms_result();
+		if (!has_result)
+			continue;
+
+		// Result timestamps are the camera clock the frame was stamped with.
+		dms::StageTimers::record(dms::Stage::GRAPH,
+			std::chrono::microseconds(cameraTimestampUs() - graph_result.timestamp_us));
+		landmark_exists = graph_result.landmark_presence;
+		output_frame = graph_result.output_frame;
+
+		while (!pending_frames.empty() && pending_frames.front().first < graph_result.timestamp_us)
+			pending_frames.pop_front();
+		if (!pending_frames.empty() && pending_frames.front().first == graph_result.timestamp_us) {
+			identity = identity_tracker.update(pending_frames.front().second, graph_result.landmarks,
+				landmark_exists, graph_result.timestamp_us);
+			pending_frames.pop_front();
+		}
+		if (landmark_exists) {
+			dms::ScopedStageTimer timer(dms::Stage::LANDMARKS);
+			landmark_frame.seq = frame_seq;
+			landmark_frame.timestamp_us = graph_result.timestamp_us;
+			landmark_frame.frame_width = input_frame.cols;
+			landmark_frame.frame_height = input_frame.rows;
+			landmark_frame.landmarks = graph_result.landmarks;
+			dms_landmarks.push(landmark_frame);
 		}
 
+		result = dms_result.read();
 
+		dms::ScopedStageTimer display_timer(dms::Stage::DISPLAY);
 		if (landmark_exists) {
 			std::string caption_fps = std::to_string(rate.get()) + " FPS";
 			std::string caption_yaw = "YAW: " + std::to_string(result.gaze_angle.yaw);
 			std::string caption_pitch = "PITCH: " + std::to_string(result.gaze_angle.pitch);
 			std::string caption_ear = "EAR: " + std::to_string(result.eye_aspect_ratio.ear);
-			std::string caption = caption_fps + "\n" + caption_yaw + "\n" + caption_pitch + "\n" + caption_ear;
-			cv::putText(output_frame, caption_fps, {10, 20}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
-			cv::putText(output_frame, caption_yaw, {10, 35}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
-			cv::putText(output_frame, caption_pitch, {10, 50}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
-			cv::putText(output_frame, caption_ear, {10, 65}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+			std::string caption_driver = "DRIVER: " + identityCaption(identity, identity_tracker.driverName());
+			std::string caption = caption_fps + "\n" + caption_yaw + "\n" + caption_pitch + "\n" + caption_ear + "\n" + caption_driver;
+			if (!headless) {
+				cv::putText(output_frame, caption_fps, {10, 20}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+				cv::putText(output_frame, caption_yaw, {10, 35}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+				cv::putText(output_frame, caption_pitch, {10, 50}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+				cv::putText(output_frame, caption_ear, {10, 65}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+				cv::putText(output_frame, caption_driver, {10, 80}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+			}
 			std::cout << caption << std::endl;
 		}
 		else {
 			std::string caption = "Face not detected.";
-			cv::putText(output_frame, caption, {10, 20}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
+			if (!headless)
+				cv::putText(output_frame, caption, {10, 20}, cv::FONT_HERSHEY_PLAIN, 1, {0, 0, 255});
 			std::cout << caption << std::endl;
 		}
-		cv::imshow("Result", output_frame);
+		if (!headless)
+			cv::imshow("Result", output_frame);
 	}
 
-	capture.release();
+	dms_landmarks.close();
 
 	th_inferrer.join();
+	std::signal(SIGINT, SIG_DFL);
+	std::signal(SIGTERM, SIG_DFL);
+
+	dms::StageTimers::report(std::cout);
+
+	return 0;
+}
+
+void printLatency(const std::string& stage, dms::LatencyStats& stats) {
+	const std::ios_base::fmtflags flags = std::cout.flags();
+	const std::streamsize precision = std::cout.precision();
+	std::cout << std::left << std::setw(10) << stage << std::right
+	          << std::setw(8) << stats.count()
+	          << std::fixed << std::setprecision(2)
+	          << std::setw(10) << stats.percentile(50)
+	          << std::setw(10) << stats.percentile(90)
+	          << std::setw(10) << stats.percentile(99)
+	          << std::setw(10) << stats.percentile(100) << std::endl;
+	std::cout.flags(flags);
+	std::cout.precision(precision);
+}
+
+/*
+Runs capture, landmarking and driver status inference on a recorded
+video as fast as possible, then prints per-stage latency percentiles
+and the overall throughput. Frames are stamped with their media
+timestamps and processed synchronously, so every frame goes through
+the graph and repeated runs are comparable.
+*/
+int replayDriver(int argc, char* argv[]) {
+	const std::string video_path = getOption(argc, argv, option_replay);
+	cv::VideoCapture capture(video_path);
+	if (!capture.isOpened()) {
+		std::cerr << "Unable to open " << video_path << std::endl;
+		return 1;
+	}
+	double video_fps = capture.get(cv::CAP_PROP_FPS);
+	if (video_fps <= 0)
+		video_fps = 30;
+
+	MPPGraphRunnerWrapper dms_runner;
+	if (!initLandmarkGraph(dms_runner, argc, argv, false))
+		return 1;
+
+	const dms::GazeMode gaze_mode = getGazeMode(argc, argv);
+	dms::GazeEstimator gaze_estimator(gaze_mode);
+	dms::EyeClosednessCalculator eye_closedness_calculator;
+	// Stage latencies go to dms::StageTimers, as when monitoring.
+
+	// The other gaze mode, run on the same landmarks outside of the timed
+	// pipeline to compare accuracy and latency
+	const bool gaze_compare = hasOption(argc, argv, option_gaze_compare);
+	dms::GazeEstimator reference_estimator(gaze_mode == dms::GazeMode::AFFINE ? dms::GazeMode::ANALYTIC : dms::GazeMode::AFFINE);
+	dms::LatencyStats yaw_difference, pitch_difference;
+
+	cv::Mat input_frame;
+	cv::Mat output_frame;
+	DMSLandmarks landmarks;
+	DMSResult result;
+	bool landmark_exists = false;
+	size_t num_frames = 0;
+	size_t num_faces = 0;
+
+	auto replay_start = std::chrono::steady_clock::now();
+	while (true) {
+		auto t_capture = std::chrono::steady_clock::now();
+		if (!capture.read(input_frame))
+			break;
+		auto t_graph = std::chrono::steady_clock::now();
+		size_t frame_timestamp = static_cast<size_t>(num_frames * 1e6 / video_fps);
+		dms_runner.processFrame(input_frame, frame_timestamp, output_frame, landmarks, landmark_exists);
+		auto t_graph_done = std::chrono::steady_clock::now();
+
+		if (landmark_exists) {
+			result.gaze_angle = gaze_estimator.estimateGaze(landmarks, input_frame.cols, input_frame.rows);
+			auto t_gaze_done = std::chrono::steady_clock::now();
+			result.eye_aspect_ratio = eye_closedness_calculator.calculateEyeClosedness(landmarks);
+			auto t_ear_done = std::chrono::steady_clock::now();
+
+			dms::StageTimers::record(dms::Stage::GAZE, t_gaze_done - t_graph_done);
+			dms::StageTimers::record(dms::Stage::EAR, t_ear_done - t_gaze_done);
+			++num_faces;
+		}
+		else {
+			gaze_estimator.reset();
+		}
+
+		dms::StageTimers::record(dms::Stage::CAPTURE, t_graph - t_capture);
+		dms::StageTimers::record(dms::Stage::GRAPH, t_graph_done - t_graph);
+		dms::StageTimers::record(dms::Stage::TOTAL, std::chrono::steady_clock::now() - t_capture);
+		++num_frames;
+
+		if (gaze_compare && landmark_exists) {
+			auto t_reference = std::chrono::steady_clock::now();
+			dms::GazeAngle reference = reference_estimator.estimateGaze(landmarks, input_frame.cols, input_frame.rows);
+			dms::StageTimers::record(dms::Stage::GAZE_ALT, std::chrono::steady_clock::now() - t_reference);
+			yaw_difference.add(std::abs(reference.yaw - result.gaze_angle.yaw));
+			pitch_difference.add(std::abs(reference.pitch - result.gaze_angle.pitch));
+		}
+		else if (gaze_compare) {
+			reference_estimator.reset();
+		}
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+
+	std::cout << "Replayed " << num_frames << " frames (" << num_faces << " with a face) in "
+	          << elapsed << " s, " << num_frames / elapsed << " FPS" << std::endl;
+	dms::StageTimers::report(std::cout);
+
+	if (gaze_compare) {
+		std::cout << "Gaze difference to the other mode (deg)" << std::endl;
+		printLatency("yaw", yaw_difference);
+		printLatency("pitch", pitch_difference);
+	}
+
+	return 0;
+}
+
+/*
+Embeds every face of a recorded video with both the dlib recognizer
+and the TFLite one given by --recognizer, then prints the latency of
+each and how far apart their descriptors are. Registered drivers only
+carry over to the TFLite recognizer if the distance stays well below
+the 0.45 match threshold.
+*/
+int compareRecognizers(int argc, char* argv[]) {
+	const std::string video_path = getOption(argc, argv, option_recognizer_parity);
+	cv::VideoCapture capture(video_path);
+	if (!capture.isOpened()) {
+		std::cerr << "Unable to open " << video_path << std::endl;
+		return 1;
+	}
+	dms::FaceModels& models = dms::FaceModels::get();
+	if (!models.quantized_recognizer) {
+		std::cerr << "No TFLite recognizer to compare, pass " << option_recognizer << std::endl;
+		return 1;
+	}
+
+	dms::LatencyStats dlib_latency, tflite_latency, descriptor_distance;
+	std::vector<float> descriptor(face_descriptor_size);
+	cv::Mat input_frame;
+	while (capture.read(input_frame)) {
+		dlib::matrix<dlib::rgb_pixel> img;
+		dlib::assign_image(img, dlib::cv_image<dlib::bgr_pixel>(input_frame));
+		for (auto face : models.detector(img)) {
+			dlib::matrix<dlib::rgb_pixel> face_chip;
+			dlib::extract_image_chip(img, dlib::get_face_chip_details(models.predictor(img, face), 150, 0.25), face_chip);
+
+			auto t_dlib = std::chrono::steady_clock::now();
+			dlib::matrix<float, 0, 1> reference = models.face_recognizer(face_chip);
+			auto t_tflite = std::chrono::steady_clock::now();
+			if (!models.quantized_recognizer->computeDescriptor(dlib::toMat(face_chip), descriptor.data()))
+				return 1;
+			auto t_done = std::chrono::steady_clock::now();
+
+			dlib_latency.add(t_tflite - t_dlib);
+			tflite_latency.add(t_done - t_tflite);
+			descriptor_distance.add(dlib::length(reference - dlib::mat(descriptor)));
+		}
+	}
+
+	std::cout << "Embedded " << dlib_latency.count() << " faces" << std::endl;
+	std::cout << std::left << std::setw(10) << "stage (ms)" << std::right
+	          << std::setw(8) << "n" << std::setw(10) << "p50" << std::setw(10) << "p90"
+	          << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+	printLatency("dlib", dlib_latency);
+	printLatency("tflite", tflite_latency);
+	std::cout << "Descriptor distance to dlib" << std::endl;
+	printLatency("distance", descriptor_distance);
 
 	return 0;
 }
 
 int runDMS(int argc, char* argv[]) {
-	int auth_ret = authenticateDriver(argc, argv);
-	int moni_ret = monitorDriver(argc, argv);
+	// Must be chosen before the models start loading.
+	const std::string recognizer_path = getOption(argc, argv, option_recognizer);
+	if (!recognizer_path.empty())
+		dms::FaceModels::useQuantizedRecognizer(recognizer_path);
+
+	// Benchmarking needs neither a camera nor a driver.
+	if (!getOption(argc, argv, option_replay).empty())
+		return replayDriver(argc, argv);
+	if (!getOption(argc, argv, option_recognizer_parity).empty())
+		return compareRecognizers(argc, argv);
+
+	// Load the face models in the background and map the registered drivers
+	// once rather than on every attempt.
+	dms::FaceModels::preload();
+	dms::DriverDatabase::shared();
+
+	// One camera session and one warm landmark graph, shared by
+	// authentication and monitoring, so monitoring starts on the frame
+	// right after the unlock.
+	dms::CameraSession camera(0);
+	MPPGraphRunnerWrapper dms_runner;
+	// Monitoring has nothing to run without the graph, so there is no
+	// point in making the driver authenticate first.
+	if (!initLandmarkGraph(dms_runner, argc, argv, true)) {
+		std::cerr << "Unable to start the landmark graph" << std::endl;
+		return 1;
+	}
+	warmUpLandmarkGraph(dms_runner, camera);
+
+	// `kill -USR1` prints the stage latencies of the monitoring loop so far.
+	std::signal(SIGUSR1, [](int) { dms::StageTimers::requestReport(); });
+
+	std::string driver_name;
+	int auth_ret = authenticateDriver(argc, argv, camera, &dms_runner, driver_name);
+	int moni_ret = monitorDriver(argc, argv, camera, dms_runner, driver_name);
 
 	return auth_ret | moni_ret; // ??
 }
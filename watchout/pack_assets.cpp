@@ -0,0 +1,20 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "asset_bundle.hpp"
+
+// Usage: pack_assets <bundle> <file>...
+// Packs the model files WatchOut loads at startup into one asset bundle.
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <bundle> <file>..." << std::endl;
+		return 1;
+	}
+	const std::vector<std::string> files(argv + 2, argv + argc);
+	if (!dms::AssetBundle::pack(argv[1], files)) {
+		std::cerr << "Error: Unable to write " << argv[1] << std::endl;
+		return 1;
+	}
+	return 0;
+}